@@ -0,0 +1,231 @@
+#include "acpi.h"
+#include "../mm/vmm.h"
+#include "../mm/pmm.h"
+#include "../libc/string.h"
+
+// Таблицы ACPI лежат где угодно в физической памяти; на время разбора
+// они отображаются в это окно и снимаются после копирования данных
+#define ACPI_WINDOW 0xE1000000
+#define ACPI_WINDOW_PAGES 64
+
+#define MADT_LAPIC 0
+#define MADT_IOAPIC 1
+#define MADT_OVERRIDE 2
+#define MADT_LAPIC_OVERRIDE 5
+
+typedef struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct acpi_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct acpi_madt {
+    acpi_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct madt_lapic {
+    madt_entry_t entry;
+    uint8_t cpu_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct madt_ioapic {
+    madt_entry_t entry;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct madt_override {
+    madt_entry_t entry;
+    uint8_t bus;
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_override_t;
+
+typedef struct madt_lapic_override {
+    madt_entry_t entry;
+    uint16_t reserved;
+    uint64_t addr;
+} __attribute__((packed)) madt_lapic_override_t;
+
+static acpi_madt_info_t madt_info;
+static uint32_t window_used = 0;
+
+static void* acpi_map(uint32_t phys, uint32_t length) {
+    uint32_t first = phys & 0xFFFFF000;
+    uint32_t pages = (phys + length - first + 0xFFF) >> 12;
+    if (window_used + pages > ACPI_WINDOW_PAGES) {
+        return 0;
+    }
+
+    uint32_t virt = ACPI_WINDOW + (window_used << 12);
+    vmm_map_range(virt, first, pages, PAGE_PRESENT);
+    window_used += pages;
+    return (void*)(virt + (phys & 0xFFF));
+}
+
+static int checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr < end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return 0;
+}
+
+// Сегмент EBDA из области данных BIOS
+#define BDA_EBDA_SEGMENT 0x40E
+
+// Слово нижней памяти читается ассемблером: обращение по константному
+// адресу вблизи нуля GCC считает выходом за границы объекта
+static inline uint16_t low_read16(uint32_t addr) {
+    uint16_t value;
+    __asm__ volatile("movw (%1), %0" : "=r"(value) : "r"(addr) : "memory");
+    return value;
+}
+
+// RSDP ищется в первом килобайте EBDA и в области BIOS 0xE0000-0xFFFFF,
+// обе лежат в тождественно отображённом нижнем мегабайте
+static acpi_rsdp_t* find_rsdp(void) {
+    uint32_t ebda = (uint32_t)low_read16(BDA_EBDA_SEGMENT) << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        acpi_rsdp_t* rsdp = scan_rsdp(ebda, ebda + 1024);
+        if (rsdp) {
+            return rsdp;
+        }
+    }
+    return scan_rsdp(0xE0000, 0x100000);
+}
+
+// Целиком отображается только таблица с нужной подписью
+static acpi_header_t* map_table(uint32_t phys, const char* signature) {
+    acpi_header_t* header = (acpi_header_t*)acpi_map(phys, sizeof(acpi_header_t));
+    if (header == 0 || memcmp(header->signature, signature, 4) != 0) {
+        return 0;
+    }
+
+    uint32_t length = header->length;
+    if (length < sizeof(acpi_header_t)) {
+        return 0;
+    }
+    header = (acpi_header_t*)acpi_map(phys, length);
+    if (header == 0 || !checksum_ok(header, length)) {
+        return 0;
+    }
+    return header;
+}
+
+static void parse_madt(acpi_madt_t* madt) {
+    madt_info.lapic_addr = madt->lapic_addr;
+
+    uint32_t addr = (uint32_t)(madt + 1);
+    uint32_t end = (uint32_t)madt + madt->header.length;
+
+    while (addr + sizeof(madt_entry_t) <= end) {
+        madt_entry_t* entry = (madt_entry_t*)addr;
+        if (entry->length < sizeof(madt_entry_t) || addr + entry->length > end) {
+            break;
+        }
+
+        if (entry->type == MADT_LAPIC) {
+            madt_lapic_t* lapic = (madt_lapic_t*)entry;
+            if (lapic->flags & 1) {
+                madt_info.cpu_count++;
+            }
+        } else if (entry->type == MADT_IOAPIC) {
+            madt_ioapic_t* ioapic = (madt_ioapic_t*)entry;
+            if (madt_info.ioapic_count < ACPI_MAX_IOAPICS) {
+                acpi_ioapic_t* info = &madt_info.ioapics[madt_info.ioapic_count++];
+                info->id = ioapic->id;
+                info->addr = ioapic->addr;
+                info->gsi_base = ioapic->gsi_base;
+            }
+        } else if (entry->type == MADT_OVERRIDE) {
+            madt_override_t* override = (madt_override_t*)entry;
+            if (override->bus == 0 && override->source < ACPI_ISA_IRQS) {
+                madt_info.irq_gsi[override->source] = override->gsi;
+                madt_info.irq_flags[override->source] = override->flags;
+            }
+        } else if (entry->type == MADT_LAPIC_OVERRIDE) {
+            madt_lapic_override_t* override = (madt_lapic_override_t*)entry;
+            if (override->addr < 0x100000000ULL) {
+                madt_info.lapic_addr = (uint32_t)override->addr;
+            }
+        }
+
+        addr += entry->length;
+    }
+}
+
+int acpi_init(void) {
+    memset(&madt_info, 0, sizeof(madt_info));
+    for (uint32_t i = 0; i < ACPI_ISA_IRQS; i++) {
+        madt_info.irq_gsi[i] = i;
+    }
+
+    acpi_rsdp_t* rsdp = find_rsdp();
+    if (rsdp == 0) {
+        return -1;
+    }
+
+    window_used = 0;
+    int found = 0;
+
+    acpi_header_t* rsdt = map_table(rsdp->rsdt_addr, "RSDT");
+    if (rsdt) {
+        uint32_t count = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+        uint32_t* entries = (uint32_t*)(rsdt + 1);
+
+        for (uint32_t i = 0; i < count && !found; i++) {
+            acpi_header_t* table = map_table(entries[i], "APIC");
+            if (table) {
+                parse_madt((acpi_madt_t*)table);
+                found = 1;
+            }
+        }
+    }
+
+    vmm_unmap_range(ACPI_WINDOW, window_used);
+    window_used = 0;
+
+    return found && madt_info.ioapic_count ? 0 : -1;
+}
+
+const acpi_madt_info_t* acpi_get_madt(void) {
+    return &madt_info;
+}
@@ -0,0 +1,34 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "../libc/stdint.h"
+
+#define ACPI_MAX_IOAPICS 4
+#define ACPI_ISA_IRQS 16
+
+// Флаги MPS INTI из записей переопределения источника прерывания
+#define ACPI_POLARITY_MASK 0x3
+#define ACPI_POLARITY_LOW 0x3
+#define ACPI_TRIGGER_MASK 0xC
+#define ACPI_TRIGGER_LEVEL 0xC
+
+typedef struct acpi_ioapic {
+    uint8_t id;
+    uint32_t addr;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+// Сведения из MADT, скопированные при разборе
+typedef struct acpi_madt_info {
+    uint32_t lapic_addr;
+    uint32_t cpu_count;
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    uint32_t irq_gsi[ACPI_ISA_IRQS];
+    uint16_t irq_flags[ACPI_ISA_IRQS];
+} acpi_madt_info_t;
+
+int acpi_init(void);
+const acpi_madt_info_t* acpi_get_madt(void);
+
+#endif
@@ -0,0 +1,144 @@
+#include "apic.h"
+#include "acpi.h"
+#include "cpuid.h"
+#include "msr.h"
+#include "ports.h"
+#include "../mm/vmm.h"
+
+#define APIC_BASE_ENABLE 0x800
+#define LAPIC_SVR_ENABLE 0x100
+
+#define IOAPIC_REGSEL 0
+#define IOAPIC_WINDOW 4
+#define IOAPIC_VER 0x01
+#define IOAPIC_REDTBL 0x10
+
+#define IOAPIC_ACTIVE_LOW (1 << 13)
+#define IOAPIC_LEVEL (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+#define IRQ_BASE_VECTOR 32
+
+volatile uint32_t* lapic_base = 0;
+
+typedef struct ioapic {
+    volatile uint32_t* base;
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+} ioapic_t;
+
+static ioapic_t ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+static uint32_t lapic_id = 0;
+static int active = 0;
+
+// Регистры APIC отображаются тождественно и без кэширования
+static volatile uint32_t* map_mmio(uint32_t phys) {
+    vmm_map_page(phys & 0xFFFFF000, phys & 0xFFFFF000, PAGE_PRESENT | PAGE_WRITE | PAGE_PCD | PAGE_PWT);
+    return (volatile uint32_t*)phys;
+}
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg >> 2];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg >> 2] = value;
+}
+
+static uint32_t ioapic_read(ioapic_t* ioapic, uint32_t reg) {
+    ioapic->base[IOAPIC_REGSEL] = reg;
+    return ioapic->base[IOAPIC_WINDOW];
+}
+
+static void ioapic_write(ioapic_t* ioapic, uint32_t reg, uint32_t value) {
+    ioapic->base[IOAPIC_REGSEL] = reg;
+    ioapic->base[IOAPIC_WINDOW] = value;
+}
+
+static ioapic_t* ioapic_for(uint32_t gsi) {
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].gsi_count) {
+            return &ioapics[i];
+        }
+    }
+    return 0;
+}
+
+void ioapic_set_irq(uint8_t irq, uint8_t vector, int masked) {
+    const acpi_madt_info_t* madt = acpi_get_madt();
+    if (irq >= ACPI_ISA_IRQS) {
+        return;
+    }
+
+    uint32_t gsi = madt->irq_gsi[irq];
+    uint16_t flags = madt->irq_flags[irq];
+    ioapic_t* ioapic = ioapic_for(gsi);
+    if (ioapic == 0) {
+        return;
+    }
+
+    // По умолчанию шина ISA: фронт, активный высокий уровень
+    uint32_t low = vector;
+    if ((flags & ACPI_POLARITY_MASK) == ACPI_POLARITY_LOW) {
+        low |= IOAPIC_ACTIVE_LOW;
+    }
+    if ((flags & ACPI_TRIGGER_MASK) == ACPI_TRIGGER_LEVEL) {
+        low |= IOAPIC_LEVEL;
+    }
+    if (masked) {
+        low |= IOAPIC_MASKED;
+    }
+
+    uint32_t index = IOAPIC_REDTBL + 2 * (gsi - ioapic->gsi_base);
+    ioapic_write(ioapic, index, IOAPIC_MASKED);
+    ioapic_write(ioapic, index + 1, lapic_id << 24);
+    ioapic_write(ioapic, index, low);
+}
+
+int apic_init(void) {
+    if (!(cpuid_features_edx() & CPUID_EDX_APIC) || acpi_init() != 0) {
+        return 0;
+    }
+
+    const acpi_madt_info_t* madt = acpi_get_madt();
+
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+    wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+
+    lapic_base = map_mmio(madt->lapic_addr);
+    lapic_id = lapic_read(LAPIC_ID) >> 24;
+
+    ioapic_count = 0;
+    for (uint32_t i = 0; i < madt->ioapic_count; i++) {
+        ioapic_t* ioapic = &ioapics[ioapic_count++];
+        ioapic->base = map_mmio(madt->ioapics[i].addr);
+        ioapic->gsi_base = madt->ioapics[i].gsi_base;
+        ioapic->gsi_count = ((ioapic_read(ioapic, IOAPIC_VER) >> 16) & 0xFF) + 1;
+    }
+
+    // Legacy PIC полностью маскируется; его векторы остаются переназначенными
+    // на 0x20-0x2F, так что случайные прерывания от него не станут исключениями
+    port_byte_out(0x21, 0xFF);
+    port_byte_out(0xA1, 0xFF);
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, 0x400);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    // IRQ2 - каскад PIC, у IOAPIC его линия обычно занята таймером
+    for (uint8_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        if (irq != 2) {
+            ioapic_set_irq(irq, IRQ_BASE_VECTOR + irq, 0);
+        }
+    }
+
+    active = 1;
+    return 1;
+}
+
+int apic_enabled(void) {
+    return active;
+}
@@ -0,0 +1,36 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "../libc/stdint.h"
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+#define LAPIC_ID 0x020
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_COUNT 0x390
+#define LAPIC_TIMER_DIV 0x3E0
+
+#define LAPIC_LVT_MASKED 0x10000
+#define LAPIC_TIMER_DIV16 0x3
+
+int apic_init(void);
+int apic_enabled(void);
+
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+
+static inline void lapic_eoi(void) {
+    extern volatile uint32_t* lapic_base;
+    lapic_base[LAPIC_EOI >> 2] = 0;
+}
+
+void ioapic_set_irq(uint8_t irq, uint8_t vector, int masked);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef CPUID_H
+#define CPUID_H
+
+#include "../libc/stdint.h"
+
+#define CPUID_EDX_FPU (1 << 0)
+#define CPUID_EDX_PSE (1 << 3)
+#define CPUID_EDX_TSC (1 << 4)
+#define CPUID_EDX_APIC (1 << 9)
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE (1 << 25)
+#define CPUID_EDX_SSE2 (1 << 26)
+
+static inline void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    asm volatile("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "a" (leaf), "c" (0));
+}
+
+static inline uint32_t cpuid_features_edx(void) {
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    return d;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "fpu.h"
+#include "cpuid.h"
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+static int sse2 = 0;
+
+// Ядро само не собирается с SSE; регистры xmm используют только явные
+// пути вроде копирования памяти, сохраняя их вокруг себя
+void fpu_init(void) {
+    uint32_t edx = cpuid_features_edx();
+    sse2 = 0;
+
+    if (!(edx & CPUID_EDX_FPU)) {
+        return;
+    }
+
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    asm volatile("mov %0, %%cr0" : : "r" (cr0));
+    asm volatile("fninit");
+
+    if ((edx & CPUID_EDX_FXSR) && (edx & CPUID_EDX_SSE)) {
+        uint32_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r" (cr4));
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        asm volatile("mov %0, %%cr4" : : "r" (cr4));
+
+        sse2 = (edx & CPUID_EDX_SSE2) != 0;
+    }
+}
+
+int fpu_has_sse2(void) {
+    return sse2;
+}
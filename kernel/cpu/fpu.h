@@ -0,0 +1,9 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "../libc/stdint.h"
+
+void fpu_init(void);
+int fpu_has_sse2(void);
+
+#endif
@@ -1,130 +1,94 @@
 extern isr_handler
 extern irq_handler
 
-isr_common_stub:
+; Из кольца 0 сегменты ядра уже загружены, и их перезагрузка пропускается.
+; Селектор ds всё равно кладётся в стек ради раскладки registers_t
+; cld: прерванный код мог быть внутри std (memmove назад), а C ждёт DF = 0
+%macro COMMON_STUB 2
+%1:
     pusha
-    
-    mov ax, ds
+    cld
+
+    mov eax, ds
     push eax
-    
+
+    test byte [esp + 48], 3
+    jz .kernel
+
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
+
     push esp
-    call isr_handler
+    call %2
     add esp, 4
-    
+
     pop eax
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
+
     popa
     add esp, 8
     iret
 
-irq_common_stub:
-    pusha
-    
-    mov ax, ds
-    push eax
-    
-    mov ax, 0x10
-    mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-    
+.kernel:
     push esp
-    call irq_handler
-    add esp, 4
-    
-    pop ebx
-    mov ds, bx
-    mov es, bx
-    mov fs, bx
-    mov gs, bx
-    
+    call %2
+    add esp, 8
+
     popa
     add esp, 8
     iret
-
-%macro ISR_NOERRCODE 1
-    global isr%1
-    isr%1:
-        cli
-        push byte 0
-        push byte %1
-        jmp isr_common_stub
 %endmacro
 
-%macro ISR_ERRCODE 1
-    global isr%1
-    isr%1:
-        cli
-        push byte %1
-        jmp isr_common_stub
-%endmacro
+COMMON_STUB isr_common_stub, isr_handler
+COMMON_STUB irq_common_stub, irq_handler
 
-%macro IRQ 2
-    global irq%1
-    irq%1:
-        cli
-        push byte 0
-        push byte %2
-        jmp irq_common_stub
-%endmacro
+; Шлюзы прерываний уже сбрасывают IF, поэтому cli в заглушках не нужен.
+; Исключения 8, 10-14, 17, 21, 29 и 30 сами кладут код ошибки
+%assign i 0
+%rep 32
+isr%+i:
+%if i == 8 || (i >= 10 && i <= 14) || i == 17 || i == 21 || i == 29 || i == 30
+    push byte i
+%else
+    push byte 0
+    push byte i
+%endif
+    jmp isr_common_stub
+%assign i i+1
+%endrep
+
+%assign i 0
+%rep 16
+irq%+i:
+    push byte 0
+    push byte i + 32
+    jmp irq_common_stub
+%assign i i+1
+%endrep
+
+global isr_spurious
+isr_spurious:
+    iret
 
-ISR_NOERRCODE 0
-ISR_NOERRCODE 1
-ISR_NOERRCODE 2
-ISR_NOERRCODE 3
-ISR_NOERRCODE 4
-ISR_NOERRCODE 5
-ISR_NOERRCODE 6
-ISR_NOERRCODE 7
-ISR_ERRCODE 8
-ISR_NOERRCODE 9
-ISR_ERRCODE 10
-ISR_ERRCODE 11
-ISR_ERRCODE 12
-ISR_ERRCODE 13
-ISR_ERRCODE 14
-ISR_NOERRCODE 15
-ISR_NOERRCODE 16
-ISR_NOERRCODE 17
-ISR_NOERRCODE 18
-ISR_NOERRCODE 19
-ISR_NOERRCODE 20
-ISR_NOERRCODE 21
-ISR_NOERRCODE 22
-ISR_NOERRCODE 23
-ISR_NOERRCODE 24
-ISR_NOERRCODE 25
-ISR_NOERRCODE 26
-ISR_NOERRCODE 27
-ISR_NOERRCODE 28
-ISR_NOERRCODE 29
-ISR_NOERRCODE 30
-ISR_NOERRCODE 31
+section .data
+align 4
 
-IRQ 0, 32
-IRQ 1, 33
-IRQ 2, 34
-IRQ 3, 35
-IRQ 4, 36
-IRQ 5, 37
-IRQ 6, 38
-IRQ 7, 39
-IRQ 8, 40
-IRQ 9, 41
-IRQ 10, 42
-IRQ 11, 43
-IRQ 12, 44
-IRQ 13, 45
-IRQ 14, 46
-IRQ 15, 47
\ No newline at end of file
+; Адреса заглушек векторов 0-47 для idt_set_gate
+global isr_stub_table
+isr_stub_table:
+%assign i 0
+%rep 32
+    dd isr%+i
+%assign i i+1
+%endrep
+%assign i 0
+%rep 16
+    dd irq%+i
+%assign i i+1
+%endrep
@@ -0,0 +1,31 @@
+#ifndef IRQFLAGS_H
+#define IRQFLAGS_H
+
+#include "../libc/stdint.h"
+
+// Флаг разрешения прерываний в EFLAGS
+#define EFLAGS_IF 0x200
+
+// Запрещает прерывания и возвращает прежний EFLAGS для irq_restore
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    asm volatile("push %0; popf" : : "r" (flags) : "memory", "cc");
+}
+
+// Были ли прерывания разрешены в сохранённом состоянии
+static inline int irq_flags_enabled(uint32_t flags) {
+    return (flags & EFLAGS_IF) != 0;
+}
+
+static inline int irq_enabled(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r" (flags));
+    return irq_flags_enabled(flags);
+}
+
+#endif
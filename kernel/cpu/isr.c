@@ -1,10 +1,19 @@
 #include "isr.h"
 #include "idt.h"
 #include "ports.h"
+#include "tsc.h"
+#include "apic.h"
+#include "softirq.h"
 #include "../drivers/screen.h"
+#include "../libc/div64.h"
 
 isr_handler_t interrupt_handlers[256];
 
+static irq_stat_t irq_stats[256];
+
+// Глубина вложенности обработчиков; softirq выполняются уже вне них
+static volatile uint32_t irq_nesting = 0;
+
 static const char* exception_messages[] = {
     "Division BY Zero",
     "Debug",
@@ -41,39 +50,10 @@ static const char* exception_messages[] = {
 };
 
 void isr_init(void) {
-    idt_set_gate(0, (uint32_t)isr0, 0x08, 0x8E);
-    idt_set_gate(1, (uint32_t)isr1, 0x08, 0x8E);
-    idt_set_gate(2, (uint32_t)isr2, 0x08, 0x8E);
-    idt_set_gate(3, (uint32_t)isr3, 0x08, 0x8E);
-    idt_set_gate(4, (uint32_t)isr4, 0x08, 0x8E);
-    idt_set_gate(5, (uint32_t)isr5, 0x08, 0x8E);
-    idt_set_gate(6, (uint32_t)isr6, 0x08, 0x8E);
-    idt_set_gate(7, (uint32_t)isr7, 0x08, 0x8E);
-    idt_set_gate(8, (uint32_t)isr8, 0x08, 0x8E);
-    idt_set_gate(9, (uint32_t)isr9, 0x08, 0x8E);
-    idt_set_gate(10, (uint32_t)isr10, 0x08, 0x8E);
-    idt_set_gate(11, (uint32_t)isr11, 0x08, 0x8E);
-    idt_set_gate(12, (uint32_t)isr12, 0x08, 0x8E);
-    idt_set_gate(13, (uint32_t)isr13, 0x08, 0x8E);
-    idt_set_gate(14, (uint32_t)isr14, 0x08, 0x8E);
-    idt_set_gate(15, (uint32_t)isr15, 0x08, 0x8E);
-    idt_set_gate(16, (uint32_t)isr16, 0x08, 0x8E);
-    idt_set_gate(17, (uint32_t)isr17, 0x08, 0x8E);
-    idt_set_gate(18, (uint32_t)isr18, 0x08, 0x8E);
-    idt_set_gate(19, (uint32_t)isr19, 0x08, 0x8E);
-    idt_set_gate(20, (uint32_t)isr20, 0x08, 0x8E);
-    idt_set_gate(21, (uint32_t)isr21, 0x08, 0x8E);
-    idt_set_gate(22, (uint32_t)isr22, 0x08, 0x8E);
-    idt_set_gate(23, (uint32_t)isr23, 0x08, 0x8E);
-    idt_set_gate(24, (uint32_t)isr24, 0x08, 0x8E);
-    idt_set_gate(25, (uint32_t)isr25, 0x08, 0x8E);
-    idt_set_gate(26, (uint32_t)isr26, 0x08, 0x8E);
-    idt_set_gate(27, (uint32_t)isr27, 0x08, 0x8E);
-    idt_set_gate(28, (uint32_t)isr28, 0x08, 0x8E);
-    idt_set_gate(29, (uint32_t)isr29, 0x08, 0x8E);
-    idt_set_gate(30, (uint32_t)isr30, 0x08, 0x8E);
-    idt_set_gate(31, (uint32_t)isr31, 0x08, 0x8E);
-};
+    for (int i = 0; i < 32; i++) {
+        idt_set_gate(i, isr_stub_table[i], 0x08, 0x8E);
+    }
+}
 
 static void pic_remap(void) {
     
@@ -99,37 +79,149 @@ static void pic_remap(void) {
 
 void irq_init(void) {
     pic_remap();
-    
-    idt_set_gate(32, (uint32_t)irq0, 0x08, 0x8E);
-    idt_set_gate(33, (uint32_t)irq1, 0x08, 0x8E);
-    idt_set_gate(34, (uint32_t)irq2, 0x08, 0x8E);
-    idt_set_gate(35, (uint32_t)irq3, 0x08, 0x8E);
-    idt_set_gate(36, (uint32_t)irq4, 0x08, 0x8E);
-    idt_set_gate(37, (uint32_t)irq5, 0x08, 0x8E);
-    idt_set_gate(38, (uint32_t)irq6, 0x08, 0x8E);
-    idt_set_gate(39, (uint32_t)irq7, 0x08, 0x8E);
-    idt_set_gate(40, (uint32_t)irq8, 0x08, 0x8E);
-    idt_set_gate(41, (uint32_t)irq9, 0x08, 0x8E);
-    idt_set_gate(42, (uint32_t)irq10, 0x08, 0x8E);
-    idt_set_gate(43, (uint32_t)irq11, 0x08, 0x8E);
-    idt_set_gate(44, (uint32_t)irq12, 0x08, 0x8E);
-    idt_set_gate(45, (uint32_t)irq13, 0x08, 0x8E);
-    idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
-    idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
+
+    for (int i = 0; i < 16; i++) {
+        idt_set_gate(32 + i, isr_stub_table[32 + i], 0x08, 0x8E);
+    }
+
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)isr_spurious, 0x08, 0x8E);
 }
 
 void register_interrupt_handler(uint8_t n, isr_handler_t handler) {
     interrupt_handlers[n] = handler;
 }
 
+// Время обработчика в тактах: сумма, крайние значения и гистограмма
+// по log2, где корзина k считает вызовы длительностью [2^k, 2^(k+1))
+static void dispatch(isr_handler_t handler, registers_t* regs) {
+    uint64_t start = rdtsc();
+    irq_nesting++;
+    handler(regs);
+    irq_nesting--;
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+
+    irq_stat_t* stat = &irq_stats[regs -> int_no];
+    if (stat -> count == 0 || cycles < stat -> min_cycles) {
+        stat -> min_cycles = cycles;
+    }
+    if (cycles > stat -> max_cycles) {
+        stat -> max_cycles = cycles;
+    }
+    stat -> count++;
+    stat -> total_cycles += cycles;
+    stat -> hist[cycles ? 31 - __builtin_clz(cycles) : 0]++;
+}
+
+int in_interrupt(void) {
+    return irq_nesting != 0;
+}
+
+const irq_stat_t* irq_get_stats(uint8_t n) {
+    return &irq_stats[n];
+}
+
+void irq_reset_stats(void) {
+    for (int i = 0; i < 256; i++) {
+        irq_stats[i] = (irq_stat_t){0};
+    }
+}
+
+void irq_print_stats(void) {
+    extern void kprint(const char*);
+    extern void kprint_dec(uint32_t);
+
+    kprint("Vector    Count      Min      Avg      Max  (cycles)\n");
+    for (int i = 0; i < 256; i++) {
+        irq_stat_t* stat = &irq_stats[i];
+        if (stat -> count == 0) {
+            continue;
+        }
+
+        if (i >= 32 && i < 48) {
+            kprint("IRQ");
+            kprint_dec(i - 32);
+            kprint(i - 32 < 10 ? "     " : "    ");
+        } else {
+            kprint("INT");
+            kprint_dec(i);
+            kprint(i < 10 ? "     " : (i < 100 ? "    " : "   "));
+        }
+
+        kprint_dec(stat -> count);
+        kprint("  ");
+        kprint_dec(stat -> min_cycles);
+        kprint("  ");
+        kprint_dec((uint32_t)div64_u32(stat -> total_cycles, stat -> count, 0));
+        kprint("  ");
+        kprint_dec(stat -> max_cycles);
+        kprint("\n ");
+
+        for (int k = 0; k < IRQ_HIST_BUCKETS; k++) {
+            if (stat -> hist[k]) {
+                kprint(" 2^");
+                kprint_dec(k);
+                kprint(":");
+                kprint_dec(stat -> hist[k]);
+            }
+        }
+        kprint("\n");
+    }
+
+    kprint("Softirq: ");
+    kprint_dec(softirq_get_executed());
+    kprint(" run, ");
+    kprint_dec(softirq_get_dropped());
+    kprint(" dropped\n");
+}
+
+#define ISR_BENCH_ROUNDS 10000
+
+static void bench_handler(registers_t* regs) {
+    (void)regs;
+}
+
+// Полный путь входа и выхода из ядра: int3 с пустым обработчиком,
+// включая учёт времени в dispatch
+void isr_benchmark(void) {
+    extern void kprint(const char*);
+    extern void kprint_dec(uint32_t);
+
+    isr_handler_t saved = interrupt_handlers[3];
+    irq_stat_t saved_stat = irq_stats[3];
+    interrupt_handlers[3] = bench_handler;
+
+    uint32_t best = 0xFFFFFFFF;
+    uint64_t total = 0;
+    for (int i = 0; i < ISR_BENCH_ROUNDS; i++) {
+        uint64_t start = rdtsc();
+        asm volatile("int $3" : : : "memory");
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+
+        total += cycles;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+
+    interrupt_handlers[3] = saved;
+    irq_stats[3] = saved_stat;
+
+    kprint("Interrupt round trip (int3, ring 0), cycles: min ");
+    kprint_dec(best);
+    kprint(", avg ");
+    kprint_dec((uint32_t)div64_u32(total, ISR_BENCH_ROUNDS, 0));
+    kprint("\n");
+}
+
 void isr_handler(registers_t* regs) {
     extern void kprint(const char*);
     extern void kprint_dec(uint32_t);
+    extern void log_flush(void);
 
     if (interrupt_handlers[regs -> int_no] != 0) {
-        isr_handler_t handler = interrupt_handlers[regs -> int_no];
-        handler(regs);
+        dispatch(interrupt_handlers[regs -> int_no], regs);
     } else {
+        log_flush();
         kprint("Unhandled exception #");
         kprint_dec(regs -> int_no);
         kprint("\n");
@@ -153,13 +245,19 @@ void isr_handler(registers_t* regs) {
     }
 }
 void irq_handler(registers_t* regs) {
-    if (regs -> int_no >= 40) {
-        port_byte_out(0xA0, 0x20);
+    // EOI в LAPIC - одна запись в MMIO вместо одной-двух команд в порты PIC
+    if (apic_enabled()) {
+        lapic_eoi();
+    } else {
+        if (regs -> int_no >= 40) {
+            port_byte_out(0xA0, 0x20);
+        }
+        port_byte_out(0x20, 0x20);
     }
-    port_byte_out(0x20, 0x20);
 
     if (interrupt_handlers[regs -> int_no] != 0) {
-        isr_handler_t handler = interrupt_handlers[regs -> int_no];
-        handler(regs);
+        dispatch(interrupt_handlers[regs -> int_no], regs);
     }
+
+    softirq_run();
 }
\ No newline at end of file
@@ -12,59 +12,30 @@ typedef struct registers {
 
 typedef void (*isr_handler_t)(registers_t*);
 
+#define IRQ_HIST_BUCKETS 32
+
+typedef struct irq_stat {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t hist[IRQ_HIST_BUCKETS];
+} irq_stat_t;
+
 void isr_init(void);
 void irq_init(void);
 void register_interrupt_handler(uint8_t n, isr_handler_t handler);
 
-extern void isr0(void);
-extern void isr1(void);
-extern void isr2(void);
-extern void isr3(void);
-extern void isr4(void);
-extern void isr5(void);
-extern void isr6(void);
-extern void isr7(void);
-extern void isr8(void);
-extern void isr9(void);
-extern void isr10(void);
-extern void isr11(void);
-extern void isr12(void);
-extern void isr13(void);
-extern void isr14(void);
-extern void isr15(void);
-extern void isr16(void);
-extern void isr17(void);
-extern void isr18(void);
-extern void isr19(void);
-extern void isr20(void);
-extern void isr21(void);
-extern void isr22(void);
-extern void isr23(void);
-extern void isr24(void);
-extern void isr25(void);
-extern void isr26(void);
-extern void isr27(void);
-extern void isr28(void);
-extern void isr29(void);
-extern void isr30(void);
-extern void isr31(void);
+// Выполняется ли сейчас обработчик прерывания или исключения
+int in_interrupt(void);
 
+const irq_stat_t* irq_get_stats(uint8_t n);
+void irq_reset_stats(void);
+void irq_print_stats(void);
+void isr_benchmark(void);
 
-extern void irq0(void);
-extern void irq1(void);
-extern void irq2(void);
-extern void irq3(void);
-extern void irq4(void);
-extern void irq5(void);
-extern void irq6(void);
-extern void irq7(void);
-extern void irq8(void);
-extern void irq9(void);
-extern void irq10(void);
-extern void irq11(void);
-extern void irq12(void);
-extern void irq13(void);
-extern void irq14(void);
-extern void irq15(void);
+// Заглушки векторов 0-31 (исключения) и 32-47 (IRQ 0-15)
+extern uint32_t isr_stub_table[48];
+extern void isr_spurious(void);
 
 #endif
\ No newline at end of file
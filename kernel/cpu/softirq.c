@@ -0,0 +1,88 @@
+#include "softirq.h"
+#include "irqflags.h"
+
+typedef struct softirq_work {
+    softirq_fn_t fn;
+    uint32_t arg;
+} softirq_work_t;
+
+// Кольцо на каждый приоритет; head и tail меняются только при
+// запрещённых прерываниях
+typedef struct softirq_queue {
+    softirq_work_t items[SOFTIRQ_QUEUE_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} softirq_queue_t;
+
+static softirq_queue_t queues[SOFTIRQ_PRIORITIES];
+static volatile uint32_t pending = 0;
+static volatile int running = 0;
+static uint32_t executed = 0;
+static uint32_t dropped = 0;
+
+int softirq_raise(uint32_t priority, softirq_fn_t fn, uint32_t arg) {
+    if (priority >= SOFTIRQ_PRIORITIES) {
+        priority = SOFTIRQ_LOW;
+    }
+
+    softirq_queue_t* queue = &queues[priority];
+    uint32_t flags = irq_save();
+
+    if (queue->head - queue->tail >= SOFTIRQ_QUEUE_SIZE) {
+        dropped++;
+        irq_restore(flags);
+        return -1;
+    }
+
+    softirq_work_t* work = &queue->items[queue->head % SOFTIRQ_QUEUE_SIZE];
+    work->fn = fn;
+    work->arg = arg;
+    queue->head++;
+    pending |= 1U << priority;
+
+    irq_restore(flags);
+    return 0;
+}
+
+// Вызывается в конце irq_handler после EOI. Работа выполняется с
+// включёнными прерываниями; вложенный IRQ только ставит новую в очередь
+void softirq_run(void) {
+    if (running || pending == 0) {
+        return;
+    }
+    running = 1;
+
+    asm volatile("sti");
+
+    for (;;) {
+        asm volatile("cli");
+        uint32_t mask = pending;
+        if (mask == 0) {
+            break;
+        }
+
+        softirq_queue_t* queue = &queues[__builtin_ctz(mask)];
+        if (queue->tail == queue->head) {
+            pending &= ~(mask & -mask);
+            asm volatile("sti");
+            continue;
+        }
+
+        softirq_work_t work = queue->items[queue->tail % SOFTIRQ_QUEUE_SIZE];
+        queue->tail++;
+        asm volatile("sti");
+
+        work.fn(work.arg);
+        executed++;
+    }
+
+    running = 0;
+}
+
+uint32_t softirq_get_executed(void) {
+    return executed;
+}
+
+uint32_t softirq_get_dropped(void) {
+    return dropped;
+}
@@ -0,0 +1,22 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include "../libc/stdint.h"
+
+// Приоритеты отложенной работы: меньше - раньше
+#define SOFTIRQ_HIGH 0
+#define SOFTIRQ_NORMAL 1
+#define SOFTIRQ_LOW 2
+#define SOFTIRQ_PRIORITIES 3
+
+#define SOFTIRQ_QUEUE_SIZE 64
+
+typedef void (*softirq_fn_t)(uint32_t arg);
+
+int softirq_raise(uint32_t priority, softirq_fn_t fn, uint32_t arg);
+void softirq_run(void);
+
+uint32_t softirq_get_executed(void);
+uint32_t softirq_get_dropped(void);
+
+#endif
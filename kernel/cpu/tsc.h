@@ -0,0 +1,12 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include "../libc/stdint.h"
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+#endif
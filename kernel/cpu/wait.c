@@ -0,0 +1,19 @@
+#include "wait.h"
+
+void wait_queue_init(wait_queue_t* wq) {
+    wq->seq = 0;
+}
+
+// Вызывается при запрещённых прерываниях; sti; hlt не оставляет окна,
+// в котором пробуждение прошло бы мимо
+void wait_queue_sleep(wait_queue_t* wq) {
+    uint32_t seq = wq->seq;
+
+    while (wq->seq == seq) {
+        asm volatile("sti; hlt; cli" : : : "memory");
+    }
+}
+
+void wake_up(wait_queue_t* wq) {
+    wq->seq++;
+}
@@ -0,0 +1,31 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include "../libc/stdint.h"
+#include "irqflags.h"
+
+// Очередь ожидания для единственного потока ядра: ждущий спит в hlt,
+// пока wake_up не сменит seq. Прерывания, не относящиеся к очереди,
+// лишь обслуживаются и не возвращают ждущего к работе
+typedef struct wait_queue {
+    volatile uint32_t seq;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { 0 }
+
+void wait_queue_init(wait_queue_t* wq);
+void wait_queue_sleep(wait_queue_t* wq);
+void wake_up(wait_queue_t* wq);
+
+// Условие проверяется при запрещённых прерываниях, поэтому wake_up из
+// IRQ между проверкой и сном не теряется
+#define wait_event(wq, condition)              \
+    do {                                       \
+        uint32_t __flags = irq_save();         \
+        while (!(condition)) {                 \
+            wait_queue_sleep(wq);              \
+        }                                      \
+        irq_restore(__flags);                  \
+    } while (0)
+
+#endif
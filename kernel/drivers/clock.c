@@ -0,0 +1,109 @@
+#include "clock.h"
+#include "../cpu/ports.h"
+#include "../cpu/tsc.h"
+#include "../cpu/irqflags.h"
+#include "../libc/div64.h"
+
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61
+
+#define CALIBRATE_MS 10
+#define CALIBRATE_ROUNDS 3
+#define CLOCK_SHIFT 24
+
+static uint32_t tsc_khz = 0;
+static uint64_t tsc_base = 0;
+static uint64_t last_cycles = 0;
+
+// ns = cycles * ns_mult >> CLOCK_SHIFT, без 64-битного деления
+static uint32_t ns_mult = 0;
+
+// Один отсчёт PIT канала 2 в режиме 0: выход OUT2 (бит 5 порта 0x61)
+// поднимается, когда счётчик доходит до нуля
+static uint32_t calibrate_once(void) {
+    uint32_t count = PIT_FREQUENCY / 1000 * CALIBRATE_MS;
+
+    uint8_t gate = port_byte_in(PIT_GATE_PORT);
+    port_byte_out(PIT_GATE_PORT, (gate & ~0x02) | 0x01);
+
+    port_byte_out(PIT_COMMAND, 0xB0);
+    port_byte_out(PIT_CHANNEL2, count & 0xFF);
+    port_byte_out(PIT_CHANNEL2, (count >> 8) & 0xFF);
+
+    uint64_t start = rdtsc();
+    uint32_t spins = 0;
+    while (!(port_byte_in(PIT_GATE_PORT) & 0x20)) {
+        if (++spins == 0x1000000) {
+            break;
+        }
+    }
+    uint64_t end = rdtsc();
+
+    port_byte_out(PIT_GATE_PORT, gate);
+    return (uint32_t)(end - start);
+}
+
+void clock_init(void) {
+    // Наименьший результат меньше всех искажён опросом порта
+    uint32_t best = 0xFFFFFFFF;
+    for (int i = 0; i < CALIBRATE_ROUNDS; i++) {
+        uint32_t cycles = calibrate_once();
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+
+    uint32_t count = PIT_FREQUENCY / 1000 * CALIBRATE_MS;
+    tsc_khz = (uint32_t)div64_u32((uint64_t)best * PIT_FREQUENCY, count * 1000, 0);
+    if (tsc_khz == 0) {
+        tsc_khz = 1000000;
+    }
+
+    ns_mult = (uint32_t)div64_u32(1000000ULL << CLOCK_SHIFT, tsc_khz, 0);
+    tsc_base = rdtsc();
+    last_cycles = 0;
+}
+
+// Монотонность: значение никогда не меньше уже выданного
+uint64_t clock_cycles(void) {
+    uint32_t flags = irq_save();
+
+    uint64_t now = rdtsc() - tsc_base;
+    if (now < last_cycles) {
+        now = last_cycles;
+    }
+    last_cycles = now;
+
+    irq_restore(flags);
+    return now;
+}
+
+uint64_t clock_ns(void) {
+    uint64_t cycles = clock_cycles();
+    uint32_t high = (uint32_t)(cycles >> 32);
+    uint32_t low = (uint32_t)cycles;
+
+    return (((uint64_t)high * ns_mult) << (32 - CLOCK_SHIFT)) +
+           (((uint64_t)low * ns_mult) >> CLOCK_SHIFT);
+}
+
+uint32_t clock_tsc_khz(void) {
+    return tsc_khz;
+}
+
+static void delay_cycles(uint64_t cycles) {
+    uint64_t start = rdtsc();
+    while (rdtsc() - start < cycles) {
+        asm volatile("pause");
+    }
+}
+
+void ndelay(uint32_t ns) {
+    delay_cycles(div64_u32((uint64_t)ns * tsc_khz, 1000000, 0));
+}
+
+void udelay(uint32_t us) {
+    delay_cycles(div64_u32((uint64_t)us * tsc_khz, 1000, 0));
+}
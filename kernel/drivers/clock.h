@@ -0,0 +1,15 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "../libc/stdint.h"
+
+void clock_init(void);
+
+uint64_t clock_cycles(void);
+uint64_t clock_ns(void);
+uint32_t clock_tsc_khz(void);
+
+void ndelay(uint32_t ns);
+void udelay(uint32_t us);
+
+#endif
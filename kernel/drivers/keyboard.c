@@ -2,6 +2,9 @@
 #include "screen.h"
 #include "../cpu/isr.h"
 #include "../cpu/ports.h"
+#include "../cpu/wait.h"
+#include "../libc/string.h"
+#include "../log.h"
 
 static const char scancode_to_ascii[] = {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -19,123 +22,225 @@ static const char scancode_to_ascii_shift[] = {
     '*', 0, ' '
 };
 
-volatile char key_buffer[KEY_BUFFER_SIZE];
-volatile int key_buffer_read = 0;
-volatile int key_buffer_write = 0;
-volatile int command_ready = 0;
+#define KEY_UP 0x100
+#define KEY_DOWN 0x101
 
-static char command_buffer[KEY_BUFFER_SIZE];
-static int command_index = 0;
+// Кольцо скан-кодов: head двигает только IRQ, tail - только читатель,
+// поэтому им не нужны ни блокировка, ни запрет прерываний
+static volatile uint8_t scancodes[KEY_RING_SIZE];
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
+static volatile uint32_t ring_dropped = 0;
+static uint32_t reported_dropped = 0;
+static wait_queue_t key_wait = WAIT_QUEUE_INIT;
+
+static char history[KEY_HISTORY][KEY_LINE_MAX];
+static uint32_t history_count = 0;
 
 static int shift_pressed = 0;
 static int ctrl_pressed = 0;
 static int alt_pressed = 0;
 static int caps_lock = 0;
+static int extended = 0;
 
 static void keyboard_callback(registers_t* regs) {
     (void)regs;
 
     uint8_t scancode = port_byte_in(0x60);
+    uint32_t head = ring_head;
+
+    if (head - ring_tail >= KEY_RING_SIZE) {
+        ring_dropped++;
+        return;
+    }
+
+    scancodes[head % KEY_RING_SIZE] = scancode;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+    wake_up(&key_wait);
+}
+
+static uint8_t next_scancode(void) {
+    wait_event(&key_wait, ring_tail != __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE));
 
-    if (scancode & 0x80) {
-        scancode &= 0x7F;
+    uint8_t scancode = scancodes[ring_tail % KEY_RING_SIZE];
+    __atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+
+    // О переполнении сообщает читатель, а не IRQ: одна запись на эпизод
+    uint32_t dropped = ring_dropped;
+    if (dropped != reported_dropped) {
+        klog(LOG_WARN, "keyboard: %u scancodes dropped, ring full\n", dropped - reported_dropped);
+        reported_dropped = dropped;
+    }
+    return scancode;
+}
+
+// Следующая нажатая клавиша: ASCII, KEY_UP/KEY_DOWN. Модификаторы и
+// прокрутка консоли обрабатываются здесь же
+static int next_key(void) {
+    for (;;) {
+        uint8_t scancode = next_scancode();
+
+        // Префикс 0xE0: следующий код - расширенная клавиша
+        if (scancode == 0xE0) {
+            extended = 1;
+            continue;
+        }
+        int ext = extended;
+        extended = 0;
+
+        // E0 2A / E0 AA - фиктивный Shift вокруг серых клавиш, не настоящий
+        if (ext && ((scancode & 0x7F) == 0x2A || (scancode & 0x7F) == 0x36)) {
+            continue;
+        }
+
+        if (scancode & 0x80) {
+            scancode &= 0x7F;
+
+            if (scancode == 0x2A || scancode == 0x36) {
+                shift_pressed = 0;
+            } else if (scancode == 0x1D) {
+                ctrl_pressed = 0;
+            } else if (scancode == 0x38) {
+                alt_pressed = 0;
+            }
+            continue;
+        }
 
         if (scancode == 0x2A || scancode == 0x36) {
-            shift_pressed = 0;
+            shift_pressed = 1;
+            continue;
         } else if (scancode == 0x1D) {
-            ctrl_pressed = 0;
+            ctrl_pressed = 1;
+            continue;
         } else if (scancode == 0x38) {
-            alt_pressed = 0;
+            alt_pressed = 1;
+            continue;
+        } else if (scancode == 0x3A) {
+            caps_lock = !caps_lock;
+            continue;
         }
 
-        return;
+        // Shift+PgUp/PgDn листают историю консоли на полэкрана
+        if (shift_pressed && (scancode == 0x49 || scancode == 0x51)) {
+            screen_scroll_view(scancode == 0x49 ? VGA_HEIGHT / 2 : -(VGA_HEIGHT / 2));
+            continue;
+        }
+
+        if (ext && scancode == 0x48) {
+            return KEY_UP;
+        } else if (ext && scancode == 0x50) {
+            return KEY_DOWN;
+        }
+
+        char ascii = 0;
+        if (scancode < sizeof(scancode_to_ascii)) {
+            if (shift_pressed || caps_lock) {
+                ascii = scancode_to_ascii_shift[scancode];
+            } else {
+                ascii = scancode_to_ascii[scancode];
+            }
+        }
+
+        if (ascii != 0) {
+            screen_view_reset();
+            return ascii;
+        }
     }
+}
 
-    if (scancode == 0x2A || scancode == 0x36) {
-        shift_pressed = 1;
-        return;
-    } else if (scancode == 0x1D) {
-        ctrl_pressed = 1;
-        return;
-    } else if (scancode == 0x38) {
-        alt_pressed = 1;
-        return;
-    } else if (scancode == 0x3A) {
-        caps_lock = !caps_lock;
-        return;
+// Стирает набранное на экране и выводит строку из истории
+static int replace_line(char* buffer, int len, const char* line, int max_len) {
+    while (len > 0) {
+        screen_putchar('\b');
+        len--;
     }
 
-    char ascii = 0;
-    if (scancode < sizeof(scancode_to_ascii)) {
-        if (shift_pressed || caps_lock) {
-            ascii = scancode_to_ascii_shift[scancode];
-        } else {
-            ascii = scancode_to_ascii[scancode];
-        }
+    while (line[len] != '\0' && len < max_len - 1) {
+        buffer[len] = line[len];
+        len++;
     }
+    buffer[len] = '\0';
+    screen_write(buffer);
+    return len;
+}
 
-    if (ascii == 0) {
+static void history_add(const char* line) {
+    if (line[0] == '\0') {
         return;
     }
 
-    if (ascii == '\n') {
-        screen_putchar('\n');
-        command_buffer[command_index] = '\0';
-        command_ready = 1;
-        command_index = 0;
-        return;
-    } else if (ascii == '\b') {
-        if (command_index > 0) {
-            command_index--;
-            command_buffer[command_index] = '\0';
-            screen_putchar('\b');
-        }
+    if (history_count > 0 && strcmp(history[(history_count - 1) % KEY_HISTORY], line) == 0) {
         return;
     }
 
-    if (command_index < KEY_BUFFER_SIZE - 1) {
-        command_buffer[command_index++] = ascii;
-        screen_putchar(ascii);
-    }
+    strncpy(history[history_count % KEY_HISTORY], line, KEY_LINE_MAX - 1);
+    history[history_count % KEY_HISTORY][KEY_LINE_MAX - 1] = '\0';
+    history_count++;
 }
 
 void keyboard_init(void) {
-    register_interrupt_handler(33, keyboard_callback);
+    ring_head = 0;
+    ring_tail = 0;
+    ring_dropped = 0;
+    reported_dropped = 0;
+    history_count = 0;
+    wait_queue_init(&key_wait);
 
-    key_buffer_read = 0;
-    key_buffer_write = 0;
-    command_index = 0;
-    command_ready = 0;
+    register_interrupt_handler(33, keyboard_callback);
 }
 
 char keyboard_getchar(void) {
-    while (key_buffer_read == key_buffer_write) {
-        asm volatile("hlt");
-    }
-
-    char c = key_buffer[key_buffer_read];
-    key_buffer_read = (key_buffer_read + 1) % KEY_BUFFER_SIZE;
-    return c;
+    int key;
+    do {
+        key = next_key();
+    } while (key >= KEY_UP);
+    return (char)key;
 }
 
 int keyboard_available(void) {
-    return key_buffer_read != key_buffer_write;
+    return ring_tail != ring_head;
 }
 
-int keyboard_get_command(char* buffer, int max_len) {
-    if (!command_ready) {
-        return 0;
-    }
+uint32_t keyboard_get_dropped(void) {
+    return ring_dropped;
+}
 
+// Дисциплина строки: эхо, забой и история стрелками. Блокируется, пока
+// не нажат Enter
+int keyboard_read_line(char* buffer, int max_len) {
     int len = 0;
-    while (command_buffer[len] != '\0' && len < max_len - 1) {
-        buffer[len] = command_buffer[len];
-        len++;
+    uint32_t browse = history_count;
+    buffer[0] = '\0';
+
+    for (;;) {
+        int key = next_key();
+
+        if (key == '\n') {
+            screen_putchar('\n');
+            buffer[len] = '\0';
+            history_add(buffer);
+            return len;
+        } else if (key == '\b') {
+            if (len > 0) {
+                buffer[--len] = '\0';
+                screen_putchar('\b');
+            }
+        } else if (key == KEY_UP) {
+            uint32_t oldest = history_count > KEY_HISTORY ? history_count - KEY_HISTORY : 0;
+            if (browse > oldest) {
+                browse--;
+                len = replace_line(buffer, len, history[browse % KEY_HISTORY], max_len);
+            }
+        } else if (key == KEY_DOWN) {
+            if (browse < history_count) {
+                browse++;
+                const char* line = browse < history_count ? history[browse % KEY_HISTORY] : "";
+                len = replace_line(buffer, len, line, max_len);
+            }
+        } else if (len < max_len - 1) {
+            buffer[len++] = (char)key;
+            buffer[len] = '\0';
+            screen_putchar((char)key);
+        }
     }
-    buffer[len] = '\0';
-
-    command_buffer[0] = '\0';
-    command_ready = 0;
-
-    return 1;
-}
\ No newline at end of file
+}
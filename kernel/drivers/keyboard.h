@@ -3,16 +3,15 @@
 
 #include "../libc/stdint.h"
 
-#define KEY_BUFFER_SIZE 256
-
-extern volatile char key_buffer[KEY_BUFFER_SIZE];
-extern volatile int key_buffer_read;
-extern volatile int key_buffer_write;
-extern volatile int command_ready;
+#define KEY_RING_SIZE 1024
+#define KEY_LINE_MAX 256
+#define KEY_HISTORY 16
 
 void keyboard_init(void);
 char keyboard_getchar(void);
 int keyboard_available(void);
-int keyboard_get_command(char* buffer, int max_len);
+int keyboard_read_line(char* buffer, int max_len);
+
+uint32_t keyboard_get_dropped(void);
 
-#endif
\ No newline at end of file
+#endif
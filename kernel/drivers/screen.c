@@ -1,8 +1,22 @@
 #include "screen.h"
+#include "serial.h"
 #include "../cpu/ports.h"
+#include "../cpu/irqflags.h"
 
 static volatile uint16_t* vga_buffer = (uint16_t*)0xB8000;
 
+// Теневой буфер в RAM - кольцо строк вместе с историей: прокрутка
+// сдвигает только top. Видеопамять пишется целыми строками при сбросе
+// в конце вывода и никогда не читается
+static uint16_t lines[SCREEN_SCROLLBACK][VGA_WIDTH];
+static uint32_t top = 0;
+static uint32_t dirty = 0;
+static int redraw = 0;
+
+// Строк истории над экраном и на сколько строк просмотр сдвинут назад
+static uint32_t history = 0;
+static uint32_t view = 0;
+
 static uint8_t cursor_x = 0;
 static uint8_t cursor_y = 0;
 
@@ -16,8 +30,20 @@ static inline uint8_t vga_color(vga_color_t fg, vga_color_t bg) {
     return fg | bg << 4;
 }
 
+static inline uint16_t* line_at(uint32_t y) {
+    return lines[(top + y) & (SCREEN_SCROLLBACK - 1)];
+}
+
+static inline uint16_t* view_line(uint32_t y) {
+    return lines[(top - view + y) & (SCREEN_SCROLLBACK - 1)];
+}
+
+// При просмотре истории курсор уходит за край экрана и скрывается
 static void update_cursor(void) {
-    uint16_t pos = cursor_y * VGA_WIDTH + cursor_x;
+    uint16_t pos = VGA_WIDTH * VGA_HEIGHT;
+    if (cursor_y + view < VGA_HEIGHT) {
+        pos = (cursor_y + view) * VGA_WIDTH + cursor_x;
+    }
 
     port_byte_out(0x3D4, 0x0F);
     port_byte_out(0x3D5, (uint8_t)(pos & 0xFF));
@@ -25,38 +51,56 @@ static void update_cursor(void) {
     port_byte_out(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
 }
 
-void screen_init(void) {
-    cursor_x = 0;
-    cursor_y = 0;
-    current_color = vga_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-}
+static void clear_line(uint16_t* line) {
+    uint32_t blank = vga_entry(' ', current_color);
+    blank |= blank << 16;
 
-void screen_clear(void) {
-    for (int y = 0; y < VGA_HEIGHT; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            const int index = y * VGA_WIDTH + x;
-            vga_buffer[index] = vga_entry(' ', current_color);
-        }
+    uint32_t* cells = (uint32_t*)line;
+    for (int x = 0; x < VGA_WIDTH / 2; x++) {
+        cells[x] = blank;
     }
-    cursor_x = 0;
-    cursor_y = 0;
-    update_cursor();
 }
-void screen_scroll(void) {
-    for (int y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            vga_buffer[y * VGA_WIDTH + x] = vga_buffer[(y + 1) * VGA_WIDTH + x]; 
-        }
+
+// Строка целиком за одну rep movsl: 40 двойных слов вместо 80 записей
+// по 16 бит. Грязные строки помечаются в координатах живого экрана и
+// при просмотре истории сдвигаются вниз на view. Прерывания запрещены
+// только на копирование одной строки: вложенный писатель между строками
+// сам сбросит свои изменения, а строка всегда берётся в текущем виде
+static void flush(void) {
+    uint32_t flags = irq_save();
+    uint32_t rows = 0;
+    if (redraw) {
+        rows = (1U << VGA_HEIGHT) - 1;
+    } else if (view < VGA_HEIGHT) {
+        rows = (dirty << view) & ((1U << VGA_HEIGHT) - 1);
     }
+    dirty = 0;
+    redraw = 0;
+    irq_restore(flags);
+
+    for (uint32_t y = 0; rows; y++) {
+        if (!(rows & (1U << y))) {
+            continue;
+        }
+        rows &= ~(1U << y);
 
-    for (int x = 0; x < VGA_WIDTH; x++) {
-        vga_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', current_color);
+        flags = irq_save();
+        void* dst = (void*)(vga_buffer + y * VGA_WIDTH);
+        const void* src = view_line(y);
+        uint32_t count = VGA_WIDTH / 2;
+        asm volatile("rep movsl"
+                     : "+D" (dst), "+S" (src), "+c" (count)
+                     :
+                     : "memory");
+        irq_restore(flags);
     }
 
-    cursor_y = VGA_HEIGHT - 1;
+    flags = irq_save();
+    update_cursor();
+    irq_restore(flags);
 }
 
-void screen_putchar(char c) {
+static void put_char(char c) {
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -67,10 +111,12 @@ void screen_putchar(char c) {
     } else if (c == '\b') {
         if (cursor_x > 0) {
             cursor_x--;
-            vga_buffer[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(' ', current_color);
+            line_at(cursor_y)[cursor_x] = vga_entry(' ', current_color);
+            dirty |= 1U << cursor_y;
         }
     } else {
-        vga_buffer[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(c, current_color);
+        line_at(cursor_y)[cursor_x] = vga_entry(c, current_color);
+        dirty |= 1U << cursor_y;
         cursor_x++;
     }
 
@@ -82,14 +128,113 @@ void screen_putchar(char c) {
     if (cursor_y >= VGA_HEIGHT) {
         screen_scroll();
     }
+}
 
-    update_cursor();
+void screen_init(void) {
+    top = 0;
+    dirty = 0;
+    redraw = 0;
+    history = 0;
+    view = 0;
+    cursor_x = 0;
+    cursor_y = 0;
+    current_color = vga_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
 }
 
+void screen_clear(void) {
+    uint32_t flags = irq_save();
+
+    // История над экраном сохраняется
+    for (int y = 0; y < VGA_HEIGHT; y++) {
+        clear_line(line_at(y));
+    }
+    view = 0;
+    redraw = 1;
+    cursor_x = 0;
+    cursor_y = 0;
+
+    irq_restore(flags);
+    flush();
+}
+
+// Сдвигает только кольцо; в видеопамяти меняется весь экран, поэтому
+// все строки помечаются грязными и сбрасываются один раз за вывод.
+// Просмотр истории остаётся на тех же строках, пока они не затёрты
+void screen_scroll(void) {
+    top = (top + 1) & (SCREEN_SCROLLBACK - 1);
+    clear_line(line_at(VGA_HEIGHT - 1));
+
+    // Грязные строки живого экрана уезжают вверх вместе с кольцом. Строка,
+    // ушедшая за верхний край, при просмотре истории всё ещё видна, а в
+    // маске для неё места нет - тогда экран перерисовывается целиком
+    if ((dirty & 1) && view) {
+        redraw = 1;
+    }
+    dirty = (dirty >> 1) | 1U << (VGA_HEIGHT - 1);
+
+    if (history < SCREEN_SCROLLBACK - VGA_HEIGHT) {
+        history++;
+    }
+    if (view == 0 || view == history) {
+        redraw = 1;
+    }
+    if (view && view < history) {
+        view++;
+    }
+
+    cursor_y = VGA_HEIGHT - 1;
+}
+
+void screen_scroll_view(int delta) {
+    uint32_t flags = irq_save();
+
+    int target = (int)view + delta;
+    if (target < 0) {
+        target = 0;
+    }
+    if (target > (int)history) {
+        target = (int)history;
+    }
+
+    if ((uint32_t)target == view) {
+        irq_restore(flags);
+        return;
+    }
+    view = (uint32_t)target;
+    redraw = 1;
+
+    irq_restore(flags);
+    flush();
+}
+
+void screen_view_reset(void) {
+    if (view) {
+        screen_scroll_view(-(int)view);
+    }
+}
+
+void screen_putchar(char c) {
+    uint32_t flags = irq_save();
+    put_char(c);
+    irq_restore(flags);
+    flush();
+}
+
+// Кольцо и курсор меняются с запрещёнными прерываниями не дольше одной
+// строки вывода, сброс в видеопамять идёт после
 void screen_write(const char* str) {
     while (*str) {
-        screen_putchar(*str++);
+        uint32_t flags = irq_save();
+        for (int n = 0; *str && n < VGA_WIDTH; n++) {
+            char c = *str++;
+            put_char(c);
+            if (c == '\n') {
+                break;
+            }
+        }
+        irq_restore(flags);
     }
+    flush();
 }
 
 void screen_setcolor(uint8_t fg, uint8_t bg) {
@@ -98,6 +243,7 @@ void screen_setcolor(uint8_t fg, uint8_t bg) {
 
 void kprint(const char* str) {
     screen_write(str);
+    serial_write(str);
 }
 
 void kprint_hex(uint32_t n) {
@@ -106,7 +252,7 @@ void kprint_hex(uint32_t n) {
     buf[0] = '0';
     buf[1] = 'x';
 
-    for (int i = 7; i >= 0; i++) {
+    for (int i = 7; i >= 0; i--) {
         buf[2 + i] = hex_chars[n & 0xF];
         n >>= 4;
     }
@@ -117,12 +263,13 @@ void kprint_hex(uint32_t n) {
 
 void kprint_dec(uint32_t n) {
     if (n == 0) {
-        screen_putchar('0');
+        kprint("0");
         return;
     }
 
     char buf[16];
-    int i = 0;
+    int i = 15;
+    buf[i] = '\0';
 
     while (n > 0) {
         uint32_t q = (n >> 1) + (n >> 2);
@@ -138,11 +285,9 @@ void kprint_dec(uint32_t n) {
             r -= 10;
         }
 
-        buf[i++] = '0' + r;
+        buf[--i] = '0' + r;
         n = q;
     }
 
-    while (i > 0) {
-        screen_putchar(buf[--i]);
-    }
+    kprint(&buf[i]);
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
 
+// Строк в кольце вместе с экраном; степень двойки
+#define SCREEN_SCROLLBACK 4096
+
 typedef enum {
     VGA_COLOR_BLACK = 0,
     VGA_COLOR_BLUE = 1,
@@ -32,6 +35,10 @@ void screen_write(const char* str);
 void screen_setcolor(uint8_t fg, uint8_t bg);
 void screen_scroll(void);
 
+// delta > 0 - назад в историю, < 0 - вперёд
+void screen_scroll_view(int delta);
+void screen_view_reset(void);
+
 void kprint(const char* str);
 void kprint_hex(uint32_t n);
 void kprint_dec(uint32_t n);
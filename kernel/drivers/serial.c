@@ -0,0 +1,157 @@
+#include "serial.h"
+#include "../cpu/isr.h"
+#include "../cpu/ports.h"
+#include "../cpu/irqflags.h"
+
+#define SERIAL_IRQ_VECTOR 36
+
+#define UART_DATA 0
+#define UART_IER 1
+#define UART_FCR 2
+#define UART_IIR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_SCRATCH 7
+
+#define UART_IER_THRE 0x02
+#define UART_LCR_DLAB 0x80
+#define UART_LCR_8N1 0x03
+#define UART_MCR_LOOPBACK 0x10
+#define UART_MCR_OUT2 0x08
+#define UART_LSR_THRE 0x20
+#define UART_IIR_NONE 0x01
+#define UART_FIFO_DEPTH 16
+
+// Кольцо передачи: head двигает писатель, tail - tx_fill, который
+// зовут и писатель, и обработчик THRE. Все обращения к индексам идут
+// при запрещённых прерываниях, это и есть блокировка кольца
+static char tx_ring[SERIAL_TX_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile int tx_active = 0;
+static uint32_t tx_dropped = 0;
+static int present = 0;
+
+static void tx_fill(void) {
+    // Пустой THR значит пустой FIFO: можно отдать до 16 байт за раз
+    if (!(port_byte_in(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE)) {
+        return;
+    }
+
+    for (int i = 0; i < UART_FIFO_DEPTH && tx_tail != tx_head; i++) {
+        port_byte_out(SERIAL_COM1 + UART_DATA, tx_ring[tx_tail % SERIAL_TX_SIZE]);
+        tx_tail++;
+    }
+}
+
+static void set_thre_irq(int enable) {
+    tx_active = enable;
+    port_byte_out(SERIAL_COM1 + UART_IER, enable ? UART_IER_THRE : 0);
+}
+
+static void serial_callback(registers_t* regs) {
+    (void)regs;
+
+    while (!(port_byte_in(SERIAL_COM1 + UART_IIR) & UART_IIR_NONE)) {
+        tx_fill();
+        if (tx_tail == tx_head) {
+            set_thre_irq(0);
+            break;
+        }
+    }
+}
+
+void serial_init(void) {
+    uint16_t port = SERIAL_COM1;
+
+    port_byte_out(port + UART_IER, 0);
+    port_byte_out(port + UART_LCR, UART_LCR_DLAB);
+    port_byte_out(port + UART_DATA, 1);
+    port_byte_out(port + UART_IER, 0);
+    port_byte_out(port + UART_LCR, UART_LCR_8N1);
+    port_byte_out(port + UART_FCR, 0xC7);
+
+    // Петля: порта нет, если байт не вернулся
+    port_byte_out(port + UART_MCR, UART_MCR_LOOPBACK | 0x0E);
+    port_byte_out(port + UART_DATA, 0xAE);
+    if (port_byte_in(port + UART_DATA) != 0xAE) {
+        present = 0;
+        return;
+    }
+
+    // OUT2 пропускает прерывание UART к контроллеру
+    port_byte_out(port + UART_MCR, UART_MCR_OUT2 | 0x03);
+
+    tx_head = 0;
+    tx_tail = 0;
+    tx_active = 0;
+    register_interrupt_handler(SERIAL_IRQ_VECTOR, serial_callback);
+    present = 1;
+}
+
+int serial_present(void) {
+    return present;
+}
+
+static void tx_push(char c) {
+    tx_ring[tx_head % SERIAL_TX_SIZE] = c;
+    tx_head++;
+}
+
+// Отдаёт первую порцию в UART и включает THRE, если его ещё нет
+static void tx_kick(void) {
+    if (!tx_active) {
+        tx_fill();
+        if (tx_tail != tx_head) {
+            set_thre_irq(1);
+        }
+    }
+}
+
+// Писатель не ждёт передачи: байты уходят из обработчика THRE, который
+// включается, только пока в кольце есть данные. Места в кольце ждём с
+// разрешёнными прерываниями; если вызывающий их запретил (до sti или из
+// обработчика), остаток строки отбрасывается, а не опрашивается UART
+void serial_write(const char* str) {
+    if (!present) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+
+    while (*str) {
+        // Запас в два байта под пару \r\n
+        if (tx_head - tx_tail > SERIAL_TX_SIZE - 2) {
+            tx_kick();
+            if (!irq_flags_enabled(flags)) {
+                tx_dropped++;
+                break;
+            }
+
+            irq_restore(flags);
+            while (tx_head - tx_tail > SERIAL_TX_SIZE - 2) {
+                asm volatile("pause");
+            }
+            flags = irq_save();
+            continue;
+        }
+
+        if (*str == '\n') {
+            tx_push('\r');
+        }
+        tx_push(*str++);
+    }
+
+    tx_kick();
+    irq_restore(flags);
+}
+
+uint32_t serial_get_dropped(void) {
+    return tx_dropped;
+}
+
+void serial_putchar(char c) {
+    char buf[2] = { c, '\0' };
+    serial_write(buf);
+}
@@ -0,0 +1,18 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "../libc/stdint.h"
+
+#define SERIAL_COM1 0x3F8
+#define SERIAL_TX_SIZE 4096
+
+void serial_init(void);
+int serial_present(void);
+
+void serial_putchar(char c);
+void serial_write(const char* str);
+
+// Число строк, обрезанных из-за полного кольца при запрещённых прерываниях
+uint32_t serial_get_dropped(void);
+
+#endif
@@ -1,35 +1,395 @@
 #include "timer.h"
+#include "clock.h"
 #include "../cpu/isr.h"
 #include "../cpu/ports.h"
+#include "../cpu/apic.h"
+#include "../cpu/softirq.h"
+#include "../cpu/irqflags.h"
+#include "../cpu/wait.h"
+#include "../libc/div64.h"
 
-static volatile uint32_t tick_count = 0;
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0 0x40
+#define PIT_COMMAND 0x43
+#define PIT_MAX_COUNT 0xFFFF
+
+#define TIMER_VECTOR 32
+#define LAPIC_CALIBRATE_US 10000
+
+// Дальше этого срока таймер не программируется; раннее пробуждение
+// просто перепрограммирует его заново
+#define MAX_SLEEP_NS 0x7FFFFFFFULL
+
+// Иерархическое колесо: 4 уровня по 64 слота, тик колеса - 2^20 нс
+// (~1 мс). Слот уровня L покрывает 64^L тиков, всё колесо - ~4.9 часа;
+// более дальние сроки прижимаются к краю и переносятся повторно
+#define TICK_SHIFT 20
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN (1ULL << (WHEEL_LEVELS * WHEEL_BITS))
+
+// Уровень таймеров, снятых со слота и ожидающих вызова
+#define LEVEL_EXPIRED WHEEL_LEVELS
+
+#define TICK_NONE 0xFFFFFFFFFFFFFFFFULL
+
+static ktimer_t* wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t occupied[WHEEL_LEVELS][WHEEL_SLOTS / 32];
+static ktimer_t* expired = 0;
+
+// Следующий необработанный тик колеса
+static uint64_t wheel_now = 0;
+static uint64_t armed = TICK_NONE;
+
+static uint32_t tick_hz = 100;
+static uint32_t lapic_khz = 0;
+static volatile int run_queued = 0;
+
+static void timer_softirq(uint32_t arg);
+
+static ktimer_t** slot_head(ktimer_t* timer) {
+    if (timer->level == LEVEL_EXPIRED) {
+        return &expired;
+    }
+    return &wheel[timer->level][timer->slot];
+}
+
+static void unlink_timer(ktimer_t* timer) {
+    ktimer_t** head = slot_head(timer);
+
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+
+    if (*head == 0 && timer->level != LEVEL_EXPIRED) {
+        occupied[timer->level][timer->slot >> 5] &= ~(1U << (timer->slot & 31));
+    }
+
+    timer->next = 0;
+    timer->prev = 0;
+    timer->queued = 0;
+}
+
+static void wheel_insert(ktimer_t* timer) {
+    uint64_t expires = timer->expires;
+    if (expires < wheel_now) {
+        expires = wheel_now;
+    }
+    if (expires - wheel_now >= WHEEL_SPAN) {
+        expires = wheel_now + WHEEL_SPAN - 1;
+    }
+
+    uint64_t delta = expires - wheel_now;
+    uint32_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * WHEEL_BITS))) {
+        level++;
+    }
+    uint32_t slot = (uint32_t)(expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->queued = 1;
+    timer->prev = 0;
+    timer->next = wheel[level][slot];
+    if (timer->next) {
+        timer->next->prev = timer;
+    }
+    wheel[level][slot] = timer;
+    occupied[level][slot >> 5] |= 1U << (slot & 31);
+}
+
+// Первый занятый слот уровня, начиная с from, или -1
+static int next_slot(uint32_t level, uint32_t from) {
+    for (uint32_t word = from >> 5; word < WHEEL_SLOTS / 32; word++) {
+        uint32_t bits = occupied[level][word];
+        if (word == from >> 5) {
+            bits &= ~0U << (from & 31);
+        }
+        if (bits) {
+            return word * 32 + __builtin_ctz(bits);
+        }
+    }
+    return -1;
+}
+
+// На границе 64 тиков слот следующего уровня раскладывается вниз;
+// если и его индекс обнулился, то же делается уровнем выше
+static void cascade(uint64_t tick) {
+    for (uint32_t level = 1; level < WHEEL_LEVELS; level++) {
+        uint32_t index = (uint32_t)(tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+        ktimer_t* list = wheel[level][index];
+        wheel[level][index] = 0;
+        occupied[level][index >> 5] &= ~(1U << (index & 31));
+
+        while (list) {
+            ktimer_t* timer = list;
+            list = timer->next;
+            wheel_insert(timer);
+        }
+
+        if (index != 0) {
+            break;
+        }
+    }
+}
+
+// Тик ближайшего события колеса: точный срок для уровня 0 и момент
+// переноса для старших уровней, поэтому пробуждение не опаздывает
+static uint64_t wheel_next(void) {
+    uint64_t best = TICK_NONE;
+
+    for (uint32_t level = 0; level < WHEEL_LEVELS; level++) {
+        uint32_t shift = level * WHEEL_BITS;
+        uint64_t cur = wheel_now >> shift;
+        uint32_t index = (uint32_t)cur & WHEEL_MASK;
+        uint64_t base = cur - index;
+
+        // Слот текущего индекса старшего уровня уже перенесён, если
+        // колесо сошло с границы
+        uint32_t from = index;
+        if (level > 0 && (wheel_now & ((1ULL << shift) - 1))) {
+            from = index + 1;
+        }
+
+        int slot = next_slot(level, from);
+        if (slot < 0) {
+            slot = next_slot(level, 0);
+            base += WHEEL_SLOTS;
+        }
+        if (slot < 0) {
+            continue;
+        }
+
+        uint64_t when = (base + (uint32_t)slot) << shift;
+        if (when < best) {
+            best = when;
+        }
+    }
+
+    return best;
+}
+
+static void wheel_run(uint64_t now_tick) {
+    uint32_t flags = irq_save();
+
+    while (wheel_now <= now_tick) {
+        uint64_t tick = wheel_now;
+        uint32_t index = (uint32_t)tick & WHEEL_MASK;
+
+        if (index == 0) {
+            cascade(tick);
+        }
+
+        expired = wheel[0][index];
+        wheel[0][index] = 0;
+        occupied[0][index >> 5] &= ~(1U << (index & 31));
+        for (ktimer_t* timer = expired; timer; timer = timer->next) {
+            timer->level = LEVEL_EXPIRED;
+        }
+
+        // Новые таймеры из обработчиков ложатся уже в следующие тики
+        wheel_now = tick + 1;
+
+        while (expired) {
+            ktimer_t* timer = expired;
+            unlink_timer(timer);
+
+            irq_restore(flags);
+            timer->fn(timer->arg);
+            flags = irq_save();
+        }
+
+        // Пустые слоты пропускаются, но граница 64 тиков - никогда
+        int next = next_slot(0, index + 1);
+        uint64_t skip = tick - index + (next < 0 ? WHEEL_SLOTS : (uint32_t)next);
+        if (skip > now_tick + 1) {
+            skip = now_tick + 1;
+        }
+        if (skip > wheel_now) {
+            wheel_now = skip;
+        }
+    }
+
+    irq_restore(flags);
+}
+
+static void pit_oneshot(uint64_t ns) {
+    uint32_t count = (uint32_t)div64_u32(ns * PIT_FREQUENCY, 1000000000, 0);
+    if (count == 0) {
+        count = 1;
+    }
+    if (count > PIT_MAX_COUNT) {
+        count = PIT_MAX_COUNT;
+    }
+
+    // Канал 0, младший и старший байт, режим 0: одно прерывание
+    port_byte_out(PIT_COMMAND, 0x30);
+    port_byte_out(PIT_CHANNEL0, count & 0xFF);
+    port_byte_out(PIT_CHANNEL0, (count >> 8) & 0xFF);
+}
+
+static void lapic_oneshot(uint64_t ns) {
+    uint64_t count = div64_u32(ns * lapic_khz, 1000000, 0);
+    if (count == 0) {
+        count = 1;
+    }
+    if (count > 0xFFFFFFFF) {
+        count = 0xFFFFFFFF;
+    }
+
+    lapic_write(LAPIC_TIMER_INIT, (uint32_t)count);
+}
+
+// Программирует только ближайший срок; без таймеров прерываний нет вовсе.
+// Вызывается с запрещёнными прерываниями
+static void timer_program(void) {
+    uint64_t next = wheel_next();
+    if (next == armed) {
+        return;
+    }
+    armed = next;
+
+    if (next == TICK_NONE) {
+        if (lapic_khz) {
+            lapic_write(LAPIC_TIMER_INIT, 0);
+        }
+        return;
+    }
+
+    uint64_t now = clock_ns();
+    uint64_t target = next << TICK_SHIFT;
+    uint64_t ns = target > now ? target - now : 0;
+    if (ns > MAX_SLEEP_NS) {
+        ns = MAX_SLEEP_NS;
+    }
+
+    if (lapic_khz) {
+        lapic_oneshot(ns);
+    } else {
+        pit_oneshot(ns);
+    }
+}
 
 static void timer_callback(registers_t* regs) {
     (void)regs;
-    tick_count++;
+    armed = TICK_NONE;
+
+    if (!run_queued) {
+        if (softirq_raise(SOFTIRQ_HIGH, timer_softirq, 0) == 0) {
+            run_queued = 1;
+        } else {
+            timer_program();
+        }
+    }
+}
+
+static void timer_softirq(uint32_t arg) {
+    (void)arg;
+    run_queued = 0;
+
+    wheel_run(clock_ns() >> TICK_SHIFT);
+
+    uint32_t flags = irq_save();
+    timer_program();
+    irq_restore(flags);
+}
+
+static uint32_t lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+    udelay(LAPIC_CALIBRATE_US);
+
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_COUNT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    return elapsed / (LAPIC_CALIBRATE_US / 1000);
 }
 
 void timer_init(uint32_t frequency) {
-    register_interrupt_handler(32, timer_callback);
+    register_interrupt_handler(TIMER_VECTOR, timer_callback);
 
-    uint32_t divisor = 1193180 / frequency;
+    if (frequency) {
+        tick_hz = frequency;
+    }
+    wheel_now = clock_ns() >> TICK_SHIFT;
+    armed = TICK_NONE;
 
-    port_byte_out(0x43, 0x36);
+    // Частота LAPIC таймера заранее неизвестна, поэтому измеряется по
+    // TSC; PIT на IOAPIC при этом маскируется
+    lapic_khz = 0;
+    if (apic_enabled()) {
+        lapic_khz = lapic_timer_calibrate();
+    }
 
-    uint8_t low = (uint8_t)(divisor & 0xFF);
-    uint8_t high = (uint8_t)((divisor >> 8) & 0xFF);
+    if (lapic_khz) {
+        ioapic_set_irq(0, TIMER_VECTOR, 1);
+        lapic_write(LAPIC_LVT_TIMER, TIMER_VECTOR);
+    } else {
+        // Остановить периодический режим, оставленный BIOS
+        port_byte_out(PIT_COMMAND, 0x30);
+        port_byte_out(PIT_CHANNEL0, 0);
+        port_byte_out(PIT_CHANNEL0, 0);
+    }
+}
 
-    port_byte_out(0x40, low);
-    port_byte_out(0x40, high);
+int timer_oneshot_lapic(void) {
+    return lapic_khz != 0;
 }
 
+// Тики с частотой из timer_init выводятся из часов, а не считаются
 uint32_t timer_get_ticks(void) {
-    return tick_count;
+    return (uint32_t)div64_u32(clock_ns(), 1000000000 / tick_hz, 0);
 }
 
-void timer_wait(uint32_t ticks) {
-    uint32_t end_tick = tick_count + ticks;
-    while(tick_count < end_tick) {
-        asm volatile("hlt");
+void timer_add(ktimer_t* timer, uint64_t deadline, timer_fn_t fn, uint32_t arg) {
+    uint32_t flags = irq_save();
+
+    if (timer->queued) {
+        unlink_timer(timer);
+    }
+
+    // Округление вверх: обработчик никогда не вызывается раньше срока
+    timer->expires = (deadline + (1U << TICK_SHIFT) - 1) >> TICK_SHIFT;
+    timer->fn = fn;
+    timer->arg = arg;
+    wheel_insert(timer);
+
+    timer_program();
+    irq_restore(flags);
+}
+
+// Отмена ближайшего таймера не перепрограммирует устройство: лишнее
+// прерывание лишь найдёт пустой слот
+int timer_cancel(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+
+    int was_queued = timer->queued;
+    if (was_queued) {
+        unlink_timer(timer);
     }
-}
\ No newline at end of file
+
+    irq_restore(flags);
+    return was_queued;
+}
+
+static void wake_waiter(uint32_t arg) {
+    wake_up((wait_queue_t*)arg);
+}
+
+void timer_wait(uint32_t ticks) {
+    wait_queue_t wq = WAIT_QUEUE_INIT;
+    ktimer_t timer = {0};
+
+    timer_add(&timer, clock_ns() + (uint64_t)ticks * (1000000000 / tick_hz),
+              wake_waiter, (uint32_t)&wq);
+    wait_event(&wq, !timer.queued);
+}
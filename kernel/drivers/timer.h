@@ -3,10 +3,31 @@
 
 #include "../libc/stdint.h"
 
+typedef void (*timer_fn_t)(uint32_t arg);
+
+// Таймер принадлежит вызывающему; обнулённая структура - неактивный таймер
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer* prev;
+    uint64_t expires;
+    timer_fn_t fn;
+    uint32_t arg;
+    uint8_t queued;
+    uint8_t level;
+    uint8_t slot;
+} ktimer_t;
+
 void timer_init(uint32_t frequency);
 
 uint32_t timer_get_ticks(void);
 
 void timer_wait(uint32_t ticks);
 
-#endif
\ No newline at end of file
+// deadline - абсолютное время по clock_ns(); обработчик вызывается
+// из softirq. Повторный timer_add переставляет уже ждущий таймер
+void timer_add(ktimer_t* timer, uint64_t deadline, timer_fn_t fn, uint32_t arg);
+int timer_cancel(ktimer_t* timer);
+
+int timer_oneshot_lapic(void);
+
+#endif
@@ -2,112 +2,203 @@
 #include "cpu/gdt.h"
 #include "cpu/idt.h"
 #include "cpu/isr.h"
+#include "cpu/apic.h"
+#include "cpu/fpu.h"
 #include "drivers/keyboard.h"
 #include "drivers/timer.h"
+#include "drivers/clock.h"
+#include "drivers/serial.h"
+#include "log.h"
+#include "membench.h"
 #include "mm/pmm.h"
 #include "mm/vmm.h"
 #include "mm/heap.h"
+#include "mm/slab.h"
 #include "libc/stdint.h"
 #include "libc/string.h"
-
-typedef struct multiboot_info {
-    uint32_t flags;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-    uint32_t boot_device;
-    uint32_t cmdline;
-    uint32_t mods_count;
-    uint32_t mods_addr;
-    uint32_t syms[4];
-    uint32_t mmap_length;
-    uint32_t mmap_addr;
-} __attribute__((packed)) multiboot_info_t;
+#include "multiboot.h"
 
 void kmain(uint32_t magic, multiboot_info_t* mboot) {
     screen_init();
     screen_clear();
+    serial_init();
 
     kprint("TuiOS Kernel Starting...\n");
     kprint("=========================\n\n");
 
-    if (magic != 0x2BADB002) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
         kprint("ERROR: Invalid multiboot magic number!\n");
         for(;;);
     }
-    kprint("[OK] Multiboot verified\n");
+    kprintf("[OK] Multiboot verified\n");
+
+    if (serial_present()) {
+        kprintf("[OK] Serial console on COM1\n");
+    }
 
     gdt_init();
-    kprint("[OK] GDT initialized\n");
+    kprintf("[OK] GDT initialized\n");
 
     idt_init();
-    kprint("[OK] IDT initialized\n");
+    kprintf("[OK] IDT initialized\n");
 
     isr_init();
-    kprint("[OK] ISR initialized\n");
+    kprintf("[OK] ISR initialized\n");
 
     irq_init();
-    kprint("[OK] IRQ initialized\n");
+    kprintf("[OK] IRQ initialized\n");
+
+    fpu_init();
+    string_init();
+    kprintf("[OK] FPU initialized%s\n", fpu_has_sse2() ? " (SSE2 string ops)" : "");
 
-    uint32_t total_mem = (mboot->mem_lower + mboot->mem_upper) * 1024;
-    pmm_init(total_mem);
-    kprint("[OK] Physical memory manager initialized\n");
+    pmm_init(mboot);
+    kprintf("[OK] Physical memory manager initialized\n");
 
     vmm_init();
-    kprint("[OK] Virtual memory manager initialized\n");
+    kprintf("[OK] Virtual memory manager initialized\n");
 
     heap_init();
-    kprint("[OK] Heap initialized\n");
+    kprintf("[OK] Heap initialized\n");
+
+    slab_init();
+    kprintf("[OK] Slab allocator initialized\n");
+
+    if (apic_init()) {
+        kprintf("[OK] Local APIC and I/O APIC initialized\n");
+    } else {
+        kprintf("[OK] No APIC found, using legacy PIC\n");
+    }
 
     keyboard_init();
-    kprint("[OK] Keyboard initialized\n");
+    kprintf("[OK] Keyboard initialized\n");
+
+    clock_init();
+    kprintf("[OK] TSC calibrated: %u MHz\n", clock_tsc_khz() / 1000);
 
     timer_init(100);
-    kprint("[OK] Timer initialized\n");
+    if (timer_oneshot_lapic()) {
+        kprintf("[OK] Timer initialized (LAPIC one-shot)\n");
+    } else {
+        kprintf("[OK] Timer initialized (PIT one-shot)\n");
+    }
 
     asm volatile("sti");
-    kprint("[OK] Interrupts enabled\n");
+    kprintf("[OK] Interrupts enabled\n");
+
+    // Всё, что попало в лог после sti, выводим до приглашения
+    log_flush();
 
     kprint("\n========================\n");
     kprint("TuiOS Ready!\n");
     kprint("Type 'help' for available commands\n\n");
     kprint("TuiOS> ");
 
-    char cmd[256];
-    
+    char cmd[KEY_LINE_MAX];
+
     for(;;) {
-        int len = keyboard_get_command(cmd, 256);
-        if (len) {
-            if (cmd[0] == '\0') {
-                kprint("TuiOS> ");
-            } else if (strcmp(cmd, "help") == 0) {
-                kprint("Available commands:\n");
-                kprint("  help    - Show this help\n");
-                kprint("  clear   - Clear screen\n");
-                kprint("  hello   - Print hello message\n");
-                kprint("  mem     - Show memory info\n");
-                kprint("TuiOS> ");
-            } else if (strcmp(cmd, "clear") == 0) {
-                screen_clear();
-                kprint("TuiOS> ");
-            } else if (strcmp(cmd, "hello") == 0) {
-                kprint("Hello from TuiOS!\n");
-                kprint("TuiOS> ");
-            } else if (strcmp(cmd, "mem") == 0) {
-                kprint("Total memory: ");
-                kprint_dec(pmm_get_total_memory() / 1024);
-                kprint(" KB\n");
-                kprint("Free memory: ");
-                kprint_dec(pmm_get_free_memory() / 1024);
-                kprint(" KB\n");
-                kprint("TuiOS> ");
-            } else {
-                kprint("Unknown command: ");
-                kprint(cmd);
+        log_flush();
+        keyboard_read_line(cmd, sizeof(cmd));
+
+        if (cmd[0] == '\0') {
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "help") == 0) {
+            kprint("Available commands:\n");
+            kprint("  help     - Show this help\n");
+            kprint("  clear    - Clear screen\n");
+            kprint("  hello    - Print hello message\n");
+            kprint("  mem      - Show memory info\n");
+            kprint("  slabinfo - Show slab caches\n");
+            kprint("  heaptest - Run heap stress test\n");
+            kprint("  vmbench  - Benchmark page mapping\n");
+            kprint("  cowtest  - Check copy-on-write cloning\n");
+            kprint("  irqstat  - Show interrupt statistics\n");
+            kprint("  intbench - Benchmark interrupt entry\n");
+            kprint("  dmesg    - Show kernel log\n");
+            kprint("  membench - Benchmark memcpy/memset/memmove\n");
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "clear") == 0) {
+            screen_clear();
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "hello") == 0) {
+            kprint("Hello from TuiOS!\n");
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "mem") == 0) {
+            kprint("Total memory: ");
+            kprint_dec(pmm_get_total_memory() / 1024);
+            kprint(" KB\n");
+            kprint("Free memory: ");
+            kprint_dec(pmm_get_free_memory() / 1024);
+            kprint(" KB\n");
+            heap_stats_t heap;
+            heap_get_stats(&heap);
+            kprint("Heap: ");
+            kprint_dec(heap.heap_size / 1024);
+            kprint(" KB, resident ");
+            kprint_dec(heap.resident / 1024);
+            kprint(" KB, free ");
+            kprint_dec(heap.free_bytes / 1024);
+            kprint(" KB\n");
+            kprint("Free blocks by order:\n");
+            for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+                kprint("  ");
+                kprint_dec(order);
+                kprint(" (");
+                kprint_dec(4 << order);
+                kprint(" KB): ");
+                kprint_dec(pmm_get_free_blocks(order));
+                kprint("\n");
+            }
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "slabinfo") == 0) {
+            kprint("cache          objsize  active  slabs\n");
+            for (kmem_cache_t* cache = kmem_cache_list(); cache; cache = cache->next) {
+                kprint(cache->name);
+                for (uint32_t i = strlen(cache->name); i < 15; i++) {
+                    kprint(" ");
+                }
+                kprint_dec(cache->object_size);
+                kprint("  ");
+                kprint_dec(cache->active);
+                kprint("  ");
+                kprint_dec(cache->slab_count);
+                kprint("\n");
+            }
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "heaptest") == 0) {
+            heap_stress_test(1000000);
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "vmbench") == 0) {
+            vmm_benchmark();
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "cowtest") == 0) {
+            vmm_cow_test();
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "irqstat") == 0) {
+            irq_print_stats();
+            kprint("Keyboard scancodes dropped: ");
+            kprint_dec(keyboard_get_dropped());
+            kprint("\n");
+            if (serial_present()) {
+                kprint("Serial writes truncated: ");
+                kprint_dec(serial_get_dropped());
                 kprint("\n");
-                kprint("TuiOS> ");
             }
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "intbench") == 0) {
+            isr_benchmark();
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "dmesg") == 0) {
+            log_dump();
+            kprint("TuiOS> ");
+        } else if (strcmp(cmd, "membench") == 0) {
+            membench_run();
+            kprint("TuiOS> ");
+        } else {
+            kprint("Unknown command: ");
+            kprint(cmd);
+            kprint("\n");
+            kprint("TuiOS> ");
         }
-        
-        asm volatile("hlt");
     }
 }
\ No newline at end of file
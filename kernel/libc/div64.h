@@ -0,0 +1,22 @@
+#ifndef DIV64_H
+#define DIV64_H
+
+#include "stdint.h"
+
+// 64/32 деление без libgcc: два divl, старшая часть первой
+static inline uint64_t div64_u32(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t high = (uint32_t)(n >> 32);
+    uint32_t low = (uint32_t)n;
+    uint32_t q_high = high / d;
+    uint32_t r = high % d;
+    uint32_t q_low;
+
+    asm("divl %4" : "=a" (q_low), "=d" (r) : "a" (low), "d" (r), "rm" (d));
+
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
+#endif
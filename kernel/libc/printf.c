@@ -0,0 +1,159 @@
+#include "printf.h"
+#include "div64.h"
+
+typedef struct out {
+    char* buf;
+    size_t size;
+    size_t pos;
+} out_t;
+
+static void put(out_t* out, char c) {
+    if (out->pos + 1 < out->size) {
+        out->buf[out->pos] = c;
+    }
+    out->pos++;
+}
+
+static void put_padded(out_t* out, const char* str, size_t len, int width, int left, char pad) {
+    int fill = width > (int)len ? width - (int)len : 0;
+
+    if (!left) {
+        while (fill-- > 0) {
+            put(out, pad);
+        }
+    }
+    for (size_t i = 0; i < len; i++) {
+        put(out, str[i]);
+    }
+    if (left) {
+        while (fill-- > 0) {
+            put(out, ' ');
+        }
+    }
+}
+
+static void put_number(out_t* out, uint64_t n, uint32_t base, int negative,
+                       int upper, int width, int left, char pad) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char buf[24];
+    int i = sizeof(buf);
+
+    // 64-битное деление только через div64_u32: без libgcc
+    do {
+        uint32_t rem;
+        n = div64_u32(n, base, &rem);
+        buf[--i] = digits[rem];
+    } while (n);
+
+    if (negative) {
+        // Знак идёт перед нулями, но после пробелов
+        if (pad == '0') {
+            put(out, '-');
+            width = width > 0 ? width - 1 : 0;
+        } else {
+            buf[--i] = '-';
+        }
+    }
+
+    put_padded(out, &buf[i], sizeof(buf) - i, width, left, pad);
+}
+
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    out_t out = { buf, size, 0 };
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            put(&out, *fmt);
+            continue;
+        }
+        fmt++;
+
+        int left = 0;
+        char pad = ' ';
+        for (;; fmt++) {
+            if (*fmt == '-') {
+                left = 1;
+            } else if (*fmt == '0') {
+                pad = '0';
+            } else {
+                break;
+            }
+        }
+        if (left) {
+            pad = ' ';
+        }
+
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+
+        int longs = 0;
+        while (*fmt == 'l') {
+            longs++;
+            fmt++;
+        }
+
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int64_t v = longs >= 2 ? va_arg(args, int64_t) : va_arg(args, int32_t);
+            uint64_t mag = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+            put_number(&out, mag, 10, v < 0, 0, width, left, pad);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X': {
+            uint64_t v = longs >= 2 ? va_arg(args, uint64_t) : va_arg(args, uint32_t);
+            put_number(&out, v, *fmt == 'u' ? 10 : 16, 0, *fmt == 'X', width, left, pad);
+            break;
+        }
+        case 'p':
+            put(&out, '0');
+            put(&out, 'x');
+            put_number(&out, (uint32_t)va_arg(args, void*), 16, 0, 0, 8, 0, '0');
+            break;
+        case 'c': {
+            char c = (char)va_arg(args, int);
+            put_padded(&out, &c, 1, width, left, ' ');
+            break;
+        }
+        case 's': {
+            const char* s = va_arg(args, const char*);
+            if (s == 0) {
+                s = "(null)";
+            }
+            size_t len = 0;
+            while (s[len]) {
+                len++;
+            }
+            put_padded(&out, s, len, width, left, ' ');
+            break;
+        }
+        case '%':
+            put(&out, '%');
+            break;
+        case '\0':
+            fmt--;
+            break;
+        default:
+            put(&out, '%');
+            put(&out, *fmt);
+            break;
+        }
+    }
+
+    if (size) {
+        buf[out.pos < size ? out.pos : size - 1] = '\0';
+    }
+    return (int)out.pos;
+}
+
+int snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
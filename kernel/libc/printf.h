@@ -0,0 +1,13 @@
+#ifndef PRINTF_H
+#define PRINTF_H
+
+#include "../libc/stdint.h"
+#include "../libc/stddef.h"
+#include "../libc/stdarg.h"
+
+// Поддерживаются %d %i %u %x %X %p %c %s %%, флаги '-' и '0', ширина
+// и модификаторы l/ll. Возвращает длину полной строки без обрезки
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int snprintf(char* buf, size_t size, const char* fmt, ...);
+
+#endif
@@ -1,35 +1,199 @@
 #include "string.h"
+#include "../cpu/fpu.h"
+
+// Меньшие блоки копируются простым циклом: запуск rep movs стоит
+// десятков тактов
+#define SMALL_THRESHOLD 64
+
+static int use_sse2 = 0;
+
+void string_init(void) {
+    use_sse2 = fpu_has_sse2();
+}
+
+int string_uses_sse2(void) {
+    return use_sse2;
+}
+
+// Без распознавания шаблона GCC заменил бы эти циклы вызовом memcpy
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void copy_small(uint8_t* d, const uint8_t* s, size_t n) {
+    for (; n >= 4; n -= 4, d += 4, s += 4) {
+        *(uint32_t*)d = *(const uint32_t*)s;
+    }
+    for (; n; n--) {
+        *d++ = *s++;
+    }
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void fill_small(uint8_t* d, uint32_t pattern, size_t n) {
+    for (; n >= 4; n -= 4, d += 4) {
+        *(uint32_t*)d = pattern;
+    }
+    for (; n; n--) {
+        *d++ = (uint8_t)pattern;
+    }
+}
+
+static inline void copy_forward(void* dest, const void* src, size_t n) {
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+    asm volatile("rep movsl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D" (dest), "+S" (src), "+c" (dwords)
+                 : "r" (bytes)
+                 : "memory");
+}
+
+static inline void fill_forward(void* dest, uint32_t pattern, size_t n) {
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+    asm volatile("rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D" (dest), "+a" (pattern), "+c" (dwords)
+                 : "r" (bytes)
+                 : "memory");
+}
+
+// Используются xmm0-xmm3; их значения сохраняются и восстанавливаются,
+// так что чужое состояние SSE не портится
+static inline void xmm_save(uint8_t* area) {
+    asm volatile("movdqu %%xmm0, 0(%0)\n\t"
+                 "movdqu %%xmm1, 16(%0)\n\t"
+                 "movdqu %%xmm2, 32(%0)\n\t"
+                 "movdqu %%xmm3, 48(%0)"
+                 : : "r" (area) : "memory");
+}
+
+static inline void xmm_restore(const uint8_t* area) {
+    asm volatile("movdqu 0(%0), %%xmm0\n\t"
+                 "movdqu 16(%0), %%xmm1\n\t"
+                 "movdqu 32(%0), %%xmm2\n\t"
+                 "movdqu 48(%0), %%xmm3"
+                 : : "r" (area) : "memory");
+}
+
+// Назначение выравнивается на 16 байт, источник читается невыровненно;
+// по 64 байта за итерацию, sfence упорядочивает записи мимо кэша
+static void copy_nt(uint8_t* dest, const uint8_t* src, size_t n) {
+    size_t head = (0 - (uintptr_t)dest) & 15;
+    copy_forward(dest, src, head);
+    dest += head;
+    src += head;
+    n -= head;
+
+    uint8_t saved[64];
+    xmm_save(saved);
+
+    size_t blocks = n >> 6;
+    asm volatile("1:\n\t"
+                 "movdqu 0(%1), %%xmm0\n\t"
+                 "movdqu 16(%1), %%xmm1\n\t"
+                 "movdqu 32(%1), %%xmm2\n\t"
+                 "movdqu 48(%1), %%xmm3\n\t"
+                 "movntdq %%xmm0, 0(%0)\n\t"
+                 "movntdq %%xmm1, 16(%0)\n\t"
+                 "movntdq %%xmm2, 32(%0)\n\t"
+                 "movntdq %%xmm3, 48(%0)\n\t"
+                 "add $64, %1\n\t"
+                 "add $64, %0\n\t"
+                 "dec %2\n\t"
+                 "jnz 1b\n\t"
+                 "sfence"
+                 : "+r" (dest), "+r" (src), "+r" (blocks)
+                 :
+                 : "memory", "cc");
+
+    xmm_restore(saved);
+    copy_forward(dest, src, n & 63);
+}
+
+static void fill_nt(uint8_t* dest, uint32_t pattern, size_t n) {
+    size_t head = (0 - (uintptr_t)dest) & 15;
+    fill_forward(dest, pattern, head);
+    dest += head;
+    n -= head;
+
+    uint8_t saved[64];
+    xmm_save(saved);
+
+    size_t blocks = n >> 6;
+    asm volatile("movd %2, %%xmm0\n\t"
+                 "pshufd $0, %%xmm0, %%xmm0\n\t"
+                 "1:\n\t"
+                 "movntdq %%xmm0, 0(%0)\n\t"
+                 "movntdq %%xmm0, 16(%0)\n\t"
+                 "movntdq %%xmm0, 32(%0)\n\t"
+                 "movntdq %%xmm0, 48(%0)\n\t"
+                 "add $64, %0\n\t"
+                 "dec %1\n\t"
+                 "jnz 1b\n\t"
+                 "sfence"
+                 : "+r" (dest), "+r" (blocks)
+                 : "r" (pattern)
+                 : "memory", "cc");
+
+    xmm_restore(saved);
+    fill_forward(dest, pattern, n & 63);
+}
 
 void* memcpy(void* dest, const void* src, size_t n) {
-    uint8_t* d = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+    if (n < SMALL_THRESHOLD) {
+        copy_small((uint8_t*)dest, (const uint8_t*)src, n);
+    } else if (use_sse2 && n >= STRING_NT_THRESHOLD) {
+        copy_nt((uint8_t*)dest, (const uint8_t*)src, n);
+    } else {
+        copy_forward(dest, src, n);
     }
     return dest;
 }
 
 void* memset(void* dest, int c, size_t n) {
-    uint8_t* d = (uint8_t*)dest;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = (uint8_t)c;
+    uint32_t pattern = (uint8_t)c * 0x01010101U;
+
+    if (n < SMALL_THRESHOLD) {
+        fill_small((uint8_t*)dest, pattern, n);
+    } else if (use_sse2 && n >= STRING_NT_THRESHOLD) {
+        fill_nt((uint8_t*)dest, pattern, n);
+    } else {
+        fill_forward(dest, pattern, n);
     }
     return dest;
 }
 
+// Перекрытие с назначением выше источника копируется с конца при DF = 1:
+// сначала хвост из n & 3 байт, затем двойные слова
 void* memmove(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
 
-    if (d < s) {
-        for (size_t i = 0; i < n; i++) {
-            d[i] = s[i];
-        }
-    } else {
-        for (size_t i = n; i > 0; i--) {
-            d[i - 1] = s[i - 1];
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    if (n < SMALL_THRESHOLD) {
+        while (n--) {
+            d[n] = s[n];
         }
+        return dest;
     }
+
+    uint8_t* d_end = d + n - 1;
+    const uint8_t* s_end = s + n - 1;
+    size_t bytes = n & 3;
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "sub $3, %%esi\n\t"
+                 "sub $3, %%edi\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D" (d_end), "+S" (s_end), "+c" (bytes)
+                 : "r" (n >> 2)
+                 : "memory", "cc");
     return dest;
 }
 
@@ -106,4 +270,4 @@ char* strchr(const char* str, int c) {
         str++;
     }
     return 0;
-}
\ No newline at end of file
+}
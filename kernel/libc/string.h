@@ -4,6 +4,14 @@
 #include "../libc/stdint.h"
 #include "../libc/stddef.h"
 
+// Начиная с этого размера копирование и заполнение идут мимо кэша
+// (movntdq), чтобы не вытеснять из него рабочие данные. Блоки меньше
+// кэша rep movsl копирует быстрее, а записанное обычно сразу читают снова
+#define STRING_NT_THRESHOLD (1024 * 1024)
+
+void string_init(void);
+int string_uses_sse2(void);
+
 void* memcpy(void* dest, const void* src, size_t n);
 void* memset(void* dest, int c, size_t n);
 void* memmove(void* dest, const void* src, size_t n);
@@ -0,0 +1,175 @@
+#include "log.h"
+#include "cpu/softirq.h"
+#include "cpu/isr.h"
+#include "cpu/irqflags.h"
+#include "drivers/screen.h"
+#include "drivers/clock.h"
+#include "libc/printf.h"
+#include "libc/div64.h"
+
+static log_record_t ring[LOG_ENTRIES];
+
+// Номер следующей записи; место резервируется атомарным xadd, так что
+// прерывание посреди записи не блокирует и не портит её
+static volatile uint32_t log_next = 0;
+
+// Номер первой ещё не выведенной на консоль записи
+static uint32_t console_seq = 0;
+static volatile int draining = 0;
+static volatile int drain_queued = 0;
+
+static const char level_tags[] = "EWID";
+
+static void log_drain(uint32_t arg);
+
+static void log_append(uint32_t level, const char* fmt, va_list args) {
+    char text[LOG_MSG_MAX];
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    if (len >= LOG_MSG_MAX) {
+        len = LOG_MSG_MAX - 1;
+    }
+
+    uint32_t seq = __atomic_fetch_add(&log_next, 1, __ATOMIC_RELAXED);
+    log_record_t* rec = &ring[seq % LOG_ENTRIES];
+
+    rec->seq = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    rec->level = (uint8_t)level;
+    rec->len = (uint8_t)len;
+    rec->timestamp = clock_ns();
+    for (int i = 0; i < len; i++) {
+        rec->text[i] = text[i];
+    }
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+
+    // Вне обработчика с запрещёнными прерываниями (например, до sti)
+    // softirq не запустится: выводим сразу, чтобы зависание при загрузке
+    // было видно
+    if (!irq_enabled() && !in_interrupt()) {
+        log_flush();
+        return;
+    }
+
+    if (!__atomic_exchange_n(&drain_queued, 1, __ATOMIC_ACQ_REL)) {
+        if (softirq_raise(SOFTIRQ_LOW, log_drain, 0) != 0) {
+            drain_queued = 0;
+        }
+    }
+}
+
+void klog(uint32_t level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_append(level, fmt, args);
+    va_end(args);
+}
+
+void kprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_append(LOG_INFO, fmt, args);
+    va_end(args);
+}
+
+// Копирует опубликованную запись; 0, если она ещё пишется или уже
+// перезаписана
+static int read_record(uint32_t seq, log_record_t* out) {
+    log_record_t* rec = &ring[seq % LOG_ENTRIES];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+        return 0;
+    }
+    *out = *rec;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    return rec->seq == seq + 1;
+}
+
+static uint32_t oldest(void) {
+    uint32_t next = log_next;
+    return next > LOG_ENTRIES ? next - LOG_ENTRIES : 0;
+}
+
+// Выводит записи до первой неопубликованной; 1, если остановились на ней
+static int drain_records(void) {
+    if (console_seq < oldest()) {
+        console_seq = oldest();
+    }
+
+    log_record_t rec;
+    while (console_seq != log_next) {
+        if (!read_record(console_seq, &rec)) {
+            // Перезаписана - догоняем; ещё пишется - допишет и поднимет softirq
+            if (console_seq < oldest()) {
+                console_seq = oldest();
+                continue;
+            }
+            return 1;
+        }
+
+        rec.text[rec.len] = '\0';
+        kprint(rec.text);
+        console_seq++;
+    }
+    return 0;
+}
+
+void log_flush(void) {
+    for (;;) {
+        if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+
+        int busy = drain_records();
+        __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+
+        // Запись из прерывания, пришедшая, пока draining был занят: её
+        // softirq уже отработал вхолостую, поэтому забираем её сами
+        if (busy || console_seq == log_next) {
+            return;
+        }
+    }
+}
+
+static void log_drain(uint32_t arg) {
+    (void)arg;
+    drain_queued = 0;
+    log_flush();
+}
+
+static void print_timestamp(uint64_t ns) {
+    char buf[24];
+    uint32_t rem;
+    uint32_t sec = (uint32_t)div64_u32(ns, 1000000000, &rem);
+    snprintf(buf, sizeof(buf), "[%5u.%06u] ", sec, rem / 1000);
+    kprint(buf);
+}
+
+// Повтор кольца с начала строки каждой записи: время и уровень
+void log_dump(void) {
+    log_record_t rec;
+    int line_start = 1;
+
+    for (uint32_t seq = oldest(); seq != log_next; seq++) {
+        if (!read_record(seq, &rec)) {
+            continue;
+        }
+
+        if (line_start) {
+            char tag[5] = { '<', level_tags[rec.level & 3], '>', ' ', '\0' };
+            print_timestamp(rec.timestamp);
+            kprint(tag);
+        }
+
+        rec.text[rec.len] = '\0';
+        kprint(rec.text);
+        line_start = rec.len && rec.text[rec.len - 1] == '\n';
+    }
+
+    if (!line_start) {
+        kprint("\n");
+    }
+}
+
+uint32_t log_get_written(void) {
+    return log_next;
+}
@@ -0,0 +1,33 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "libc/stdint.h"
+
+#define LOG_ERR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#define LOG_ENTRIES 256
+#define LOG_MSG_MAX 116
+
+// Запись кольца; seq равен номеру записи + 1 только после публикации
+typedef struct log_record {
+    volatile uint32_t seq;
+    uint8_t level;
+    uint8_t len;
+    uint64_t timestamp;
+    char text[LOG_MSG_MAX];
+} log_record_t;
+
+// Форматирует в один буфер и добавляет запись в кольцо; на экран и
+// в COM1 она попадает позже, из softirq или log_flush, а до sti - сразу
+void klog(uint32_t level, const char* fmt, ...);
+void kprintf(const char* fmt, ...);
+
+void log_flush(void);
+void log_dump(void);
+
+uint32_t log_get_written(void);
+
+#endif
@@ -0,0 +1,90 @@
+#include "membench.h"
+#include "drivers/screen.h"
+#include "mm/heap.h"
+#include "cpu/tsc.h"
+#include "libc/string.h"
+#include "libc/printf.h"
+#include "libc/div64.h"
+
+#define BENCH_MAX_SIZE (1024 * 1024)
+#define BENCH_BYTES (8 * 1024 * 1024)
+
+// Прежняя побайтовая копия для сравнения; без распознавания шаблона
+// GCC превратил бы её обратно в вызов memcpy
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void copy_bytes(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+}
+
+// Сотые доли байта за такт
+static uint32_t bench_rate(uint32_t op, uint8_t* dst, uint8_t* src, size_t size) {
+    uint32_t rounds = BENCH_BYTES / size;
+    if (rounds > 100000) {
+        rounds = 100000;
+    }
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        if (op == 0) {
+            copy_bytes(dst, src, size);
+        } else if (op == 1) {
+            memcpy(dst, src, size);
+        } else if (op == 2) {
+            memset(dst, (int)i, size);
+        } else {
+            memmove(src + 8, src, size);
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    if (cycles == 0) {
+        cycles = 1;
+    }
+    return (uint32_t)div64_u32((uint64_t)rounds * size * 100, (uint32_t)(cycles > 0xFFFFFFFF ? 0xFFFFFFFF : cycles), 0);
+}
+
+void membench_run(void) {
+    static const uint32_t sizes[] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+    static const char* names[] = { "bytes", "memcpy", "memset", "memmove" };
+
+    uint8_t* src = (uint8_t*)kmalloc(BENCH_MAX_SIZE + 64);
+    uint8_t* dst = (uint8_t*)kmalloc(BENCH_MAX_SIZE + 64);
+    if (src == 0 || dst == 0) {
+        kprint("membench: out of memory\n");
+        kfree(src);
+        kfree(dst);
+        return;
+    }
+
+    // Первое касание страниц кучи - не часть замера
+    memset(src, 0x5A, BENCH_MAX_SIZE + 64);
+    memset(dst, 0, BENCH_MAX_SIZE + 64);
+
+    char line[96];
+    snprintf(line, sizeof(line), "Bytes per cycle (%s for >= %u B):\n    size",
+             string_uses_sse2() ? "SSE2 non-temporal" : "rep movs/stos", STRING_NT_THRESHOLD);
+    kprint(line);
+    for (uint32_t op = 0; op < 4; op++) {
+        snprintf(line, sizeof(line), " %8s", names[op]);
+        kprint(line);
+    }
+    kprint("\n");
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        snprintf(line, sizeof(line), "%8u", sizes[i]);
+        kprint(line);
+        for (uint32_t op = 0; op < 4; op++) {
+            uint32_t rate = bench_rate(op, dst, src, sizes[i]);
+            snprintf(line, sizeof(line), " %5u.%02u", rate / 100, rate % 100);
+            kprint(line);
+        }
+        kprint("\n");
+    }
+
+    kfree(src);
+    kfree(dst);
+}
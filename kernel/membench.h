@@ -0,0 +1,8 @@
+#ifndef MEMBENCH_H
+#define MEMBENCH_H
+
+// Скорость memcpy/memset/memmove на блоках от 8 байт до 1 МБ в
+// сравнении с побайтовой копией
+void membench_run(void);
+
+#endif
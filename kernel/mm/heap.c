@@ -1,119 +1,657 @@
 #include "heap.h"
 #include "pmm.h"
 #include "vmm.h"
+#include "slab.h"
+#include "../cpu/tsc.h"
+#include "../libc/div64.h"
 
-#define HEAP_START 0x00600000
+#define HEAP_START 0xC0000000
+#define HEAP_LIMIT SLAB_START
 #define HEAP_INITIAL_SIZE 0x100000
+
+// Больше всего окна кучи блок быть не может; проверка до округления
+// не даёт размеру переполниться около 4 ГБ
+#define HEAP_MAX (HEAP_LIMIT - HEAP_START)
 #define HEAP_MAGIC 0x123890AB
 
+#define HEAP_FREE 0x1
+#define HEAP_SIZE_MASK 0xFFFFFFF8
+#define HEAP_OVERHEAD (sizeof(heap_block_t) + sizeof(uint32_t))
+#define HEAP_MIN_BLOCK 24
+#define HEAP_FIT_SCAN 8
+#define HEAP_BINS 24
+
+// Гистерезис возврата памяти: обрезка начинается, когда отображённой, но
+// свободной памяти больше trim_high, и останавливается на trim_low
+#define HEAP_TRIM_HIGH 0x100000
+#define HEAP_TRIM_LOW 0x40000
+#define HEAP_TRIM_MIN_BLOCK 0x10000
+
+// Заголовок блока; указатели списка корзины занимают полезную область
+// свободного блока, а в конце каждого блока лежит копия size (граничный тег)
 typedef struct heap_block {
     uint32_t magic;
     uint32_t size;
-    int is_free;
-    struct heap_block* next;
 } heap_block_t;
 
-static heap_block_t* heap_start = 0;
+typedef struct heap_free_links {
+    heap_block_t* next;
+    heap_block_t* prev;
+} heap_free_links_t;
+
+static uint32_t heap_start = 0;
 static uint32_t heap_end = 0;
 
+static heap_block_t* bins[HEAP_BINS];
+static uint32_t bin_map = 0;
+
+static uint32_t trim_high = HEAP_TRIM_HIGH;
+static uint32_t trim_low = HEAP_TRIM_LOW;
+
+// Если обрезка ничего не вернула (фрагментация), kfree не повторяет её,
+// пока свободной памяти не станет больше этой отметки
+static uint32_t trim_retry = 0;
+static uint32_t resident_pages = 0;
+static uint32_t allocated_bytes = 0;
+
 static uint32_t align_page(uint32_t addr) {
     return (addr + 0xFFF) & 0xFFFFF000;
 }
 
-void heap_init(void) {
-    heap_start = (heap_block_t*)HEAP_START;
-    heap_end = HEAP_START + HEAP_INITIAL_SIZE;
+static inline uint32_t block_size(heap_block_t* block) {
+    return block->size & HEAP_SIZE_MASK;
+}
 
-    for (uint32_t i = HEAP_START; i < heap_end; i += PAGE_SIZE) {
-        uint32_t phys = pmm_alloc_page();
-        if (phys) {
-            vmm_map_page(i, phys, PAGE_PRESENT | PAGE_WRITE);
-        }
+static inline int block_free(heap_block_t* block) {
+    return block->size & HEAP_FREE;
+}
+
+static inline heap_free_links_t* block_links(heap_block_t* block) {
+    return (heap_free_links_t*)(block + 1);
+}
+
+static inline uint32_t* block_footer(heap_block_t* block) {
+    return (uint32_t*)((uint32_t)block + block_size(block) - sizeof(uint32_t));
+}
+
+static inline heap_block_t* block_next(heap_block_t* block) {
+    return (heap_block_t*)((uint32_t)block + block_size(block));
+}
+
+static inline void block_write(heap_block_t* block, uint32_t size, uint32_t flags) {
+    block->magic = HEAP_MAGIC;
+    block->size = size | flags;
+    *block_footer(block) = size | flags;
+}
+
+static inline uint32_t bin_index(uint32_t size) {
+    uint32_t index = (31 - __builtin_clz(size)) - 4;
+    return index < HEAP_BINS ? index : HEAP_BINS - 1;
+}
+
+static void bin_insert(heap_block_t* block) {
+    uint32_t index = bin_index(block_size(block));
+    heap_free_links_t* links = block_links(block);
+
+    links->prev = 0;
+    links->next = bins[index];
+    if (bins[index]) {
+        block_links(bins[index])->prev = block;
     }
+    bins[index] = block;
+    bin_map |= (1U << index);
+}
 
-    heap_start->magic = HEAP_MAGIC;
-    heap_start->size = HEAP_INITIAL_SIZE - sizeof(heap_block_t);
-    heap_start->is_free = 1;
-    heap_start->next = 0;
+static void bin_remove(heap_block_t* block) {
+    uint32_t index = bin_index(block_size(block));
+    heap_free_links_t* links = block_links(block);
+
+    if (links->prev) {
+        block_links(links->prev)->next = links->next;
+    } else {
+        bins[index] = links->next;
+    }
+    if (links->next) {
+        block_links(links->next)->prev = links->prev;
+    }
+
+    if (bins[index] == 0) {
+        bin_map &= ~(1U << index);
+    }
+}
+
+// Сливает свободный блок с соседями по граничным тегам и кладёт в корзину
+static heap_block_t* coalesce(heap_block_t* block) {
+    uint32_t size = block_size(block);
+
+    heap_block_t* next = block_next(block);
+    if (block_free(next)) {
+        bin_remove(next);
+        size += block_size(next);
+    }
+
+    uint32_t prev_tag = *(uint32_t*)((uint32_t)block - sizeof(uint32_t));
+    if (prev_tag & HEAP_FREE) {
+        heap_block_t* prev = (heap_block_t*)((uint32_t)block - (prev_tag & HEAP_SIZE_MASK));
+        bin_remove(prev);
+        size += block_size(prev);
+        block = prev;
+    }
+
+    block_write(block, size, HEAP_FREE);
+    bin_insert(block);
+    return block;
+}
+
+// Куча отображается по требованию: кадр подставляется при первом
+// обращении к зарезервированной странице между heap_start и heap_end
+static int heap_fault(uint32_t addr, uint32_t err_code) {
+    if ((err_code & 0x1) || addr < heap_start || addr >= heap_end) {
+        return 0;
+    }
+
+    uint32_t phys = pmm_alloc_page();
+    if (phys == 0) {
+        return 0;
+    }
+
+    vmm_map_page(addr & 0xFFFFF000, phys, PAGE_PRESENT | PAGE_WRITE);
+    resident_pages++;
+    return 1;
+}
+
+// Заранее отображает страницы, например перед выдачей физического адреса
+static int populate(uint32_t start, uint32_t end) {
+    for (uint32_t page = start & 0xFFFFF000; page < end; page += PAGE_SIZE) {
+        if (vmm_virt_to_phys(page) == 0) {
+            uint32_t phys = pmm_alloc_page();
+            if (phys == 0) {
+                return 0;
+            }
+            vmm_map_page(page, phys, PAGE_PRESENT | PAGE_WRITE);
+            resident_pages++;
+        }
+    }
+    return 1;
 }
 
-static void expand_heap(uint32_t size) {
-    uint32_t new_end = align_page(heap_end + size);
+static uint32_t release_range(uint32_t start, uint32_t end, uint32_t budget) {
+    uint32_t released = 0;
 
-    for (uint32_t i = heap_end; i < new_end; i += PAGE_SIZE) {
-        uint32_t phys = pmm_alloc_page();
+    for (uint32_t page = start; page < end && released < budget; page += PAGE_SIZE) {
+        uint32_t phys = vmm_virt_to_phys(page);
         if (phys) {
-            vmm_map_page(i, phys, PAGE_PRESENT | PAGE_WRITE);
+            vmm_unmap_page(page);
+            pmm_free_page(phys & 0xFFFFF000);
+            resident_pages--;
+            released++;
         }
     }
 
-    heap_end = new_end;
+    return released;
 }
 
-void* kmalloc(uint32_t size) {
-    if (size == 0) {
+static inline uint32_t free_resident(void) {
+    uint32_t resident = resident_pages << 12;
+    return resident > allocated_bytes ? resident - allocated_bytes : 0;
+}
+
+void heap_init(void) {
+    heap_start = HEAP_START;
+    heap_end = HEAP_START + HEAP_INITIAL_SIZE;
+    resident_pages = 0;
+    allocated_bytes = 0;
+    trim_retry = 0;
+
+    vmm_register_fault_handler(HEAP_START, HEAP_LIMIT, heap_fault);
+
+    for (uint32_t i = 0; i < HEAP_BINS; i++) {
+        bins[i] = 0;
+    }
+    bin_map = 0;
+
+    // Пролог (занятый граничный тег) и эпилог (занятый заголовок нулевого
+    // размера) избавляют слияние от проверок границ кучи
+    *(uint32_t*)(heap_start + sizeof(uint32_t)) = 0;
+
+    heap_block_t* first = (heap_block_t*)(heap_start + sizeof(heap_block_t));
+    block_write(first, heap_end - heap_start - 2 * sizeof(heap_block_t), HEAP_FREE);
+
+    heap_block_t* epilogue = (heap_block_t*)(heap_end - sizeof(heap_block_t));
+    epilogue->magic = HEAP_MAGIC;
+    epilogue->size = 0;
+
+    bin_insert(first);
+}
+
+static int expand_heap(uint32_t size) {
+    if (size > HEAP_LIMIT - heap_end) {
         return 0;
     }
 
-    size = (size + 3) & ~3;
+    // Только резервирование: страницы подставит heap_fault, поэтому
+    // heap_end сдвигается до записи тегов в новую область
+    uint32_t old_end = heap_end;
+    heap_end = align_page(heap_end + size);
+
+    // Старый эпилог становится заголовком нового свободного блока
+    heap_block_t* block = (heap_block_t*)(old_end - sizeof(heap_block_t));
+    block_write(block, heap_end - old_end, HEAP_FREE);
+
+    heap_block_t* epilogue = (heap_block_t*)(heap_end - sizeof(heap_block_t));
+    epilogue->magic = HEAP_MAGIC;
+    epilogue->size = 0;
+
+    coalesce(block);
+    return 1;
+}
+
+static heap_block_t* find_fit(uint32_t size) {
+    uint32_t index = bin_index(size);
 
-    heap_block_t* current = heap_start;
+    // В своей корзине смотрим несколько первых блоков, лучший из них
+    heap_block_t* best = 0;
+    heap_block_t* block = bins[index];
+    for (uint32_t i = 0; block && i < HEAP_FIT_SCAN; i++) {
+        uint32_t bsize = block_size(block);
+        if (bsize >= size && (best == 0 || bsize < block_size(best))) {
+            best = block;
+            if (bsize == size) {
+                break;
+            }
+        }
+        block = block_links(block)->next;
+    }
+    if (best) {
+        return best;
+    }
+
+    // Любой блок из старших корзин заведомо подходит
+    uint32_t mask = (index + 1 < HEAP_BINS) ? bin_map & (0xFFFFFFFF << (index + 1)) : 0;
+    if (mask) {
+        return bins[__builtin_ctz(mask)];
+    }
 
-    while (current) {
-        if (current->magic != HEAP_MAGIC) {
+    return 0;
+}
+
+static inline uint32_t block_need(uint32_t size) {
+    uint32_t need = (size + HEAP_OVERHEAD + 7) & HEAP_SIZE_MASK;
+    return need < HEAP_MIN_BLOCK ? HEAP_MIN_BLOCK : need;
+}
+
+// Отрезает от свободного блока (уже вынутого из корзины) need байт
+static void* carve(heap_block_t* block, uint32_t bsize, uint32_t need) {
+    if (bsize - need >= HEAP_MIN_BLOCK) {
+        heap_block_t* rest = (heap_block_t*)((uint32_t)block + need);
+        block_write(rest, bsize - need, HEAP_FREE);
+        bin_insert(rest);
+        bsize = need;
+    }
+
+    block_write(block, bsize, 0);
+    allocated_bytes += bsize;
+    return (void*)(block + 1);
+}
+
+static heap_block_t* take_fit(uint32_t size) {
+    heap_block_t* block = find_fit(size);
+    if (block == 0) {
+        if (!expand_heap(size)) {
+            return 0;
+        }
+        block = find_fit(size);
+        if (block == 0) {
             return 0;
         }
+    }
 
-        if (current->is_free && current->size >= size) {
-            if (current->size > size + sizeof(heap_block_t) + 16) {
-                heap_block_t* new_block = (heap_block_t*)((uint32_t)current + sizeof(heap_block_t) + size);
-                new_block->magic = HEAP_MAGIC;
-                new_block->size = current->size - size - sizeof(heap_block_t);
-                new_block->is_free = 1;
-                new_block->next = current->next;
+    bin_remove(block);
+    return block;
+}
 
-                current->size = size;
-                current->next = new_block;
-            }
+static void* heap_alloc(uint32_t size) {
+    if (size > HEAP_MAX - HEAP_OVERHEAD) {
+        return 0;
+    }
+    uint32_t need = block_need(size);
+
+    heap_block_t* block = take_fit(need);
+    if (block == 0) {
+        return 0;
+    }
+
+    return carve(block, block_size(block), need);
+}
+
+static void* heap_alloc_aligned(uint32_t size, uint32_t align) {
+    if (size > HEAP_MAX - HEAP_OVERHEAD) {
+        return 0;
+    }
+    uint32_t need = block_need(size);
+    if (need > HEAP_MAX - HEAP_MIN_BLOCK || align > HEAP_MAX - HEAP_MIN_BLOCK - need) {
+        return 0;
+    }
 
-            current->is_free = 0;
-            return (void*)((uint32_t)current + sizeof(heap_block_t));
+    heap_block_t* block = take_fit(need + align + HEAP_MIN_BLOCK);
+    if (block == 0) {
+        return 0;
+    }
+
+    uint32_t start = (uint32_t)block;
+    uint32_t bsize = block_size(block);
+
+    // Промежуток перед выровненным блоком становится отдельным свободным
+    // блоком, поэтому он должен вмещать хотя бы минимальный блок
+    uint32_t payload = (start + sizeof(heap_block_t) + align - 1) & ~(align - 1);
+    uint32_t lead = payload - sizeof(heap_block_t) - start;
+    if (lead && lead < HEAP_MIN_BLOCK) {
+        payload += align;
+        lead += align;
+    }
+
+    heap_block_t* aligned = (heap_block_t*)(payload - sizeof(heap_block_t));
+    uint32_t rest = bsize - lead;
+
+    if (lead) {
+        block_write(block, lead, HEAP_FREE);
+        bin_insert(block);
+    }
+
+    return carve(aligned, rest, need);
+}
+
+void* kmalloc(uint32_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    if (size <= KMALLOC_MAX_CACHE_SIZE) {
+        void* obj = slab_kmalloc(size);
+        if (obj) {
+            return obj;
         }
+    }
 
-        current = current->next;
+    return heap_alloc(size);
+}
+
+void* kmalloc_align(uint32_t size, uint32_t align) {
+    if (size == 0 || (align & (align - 1))) {
+        return 0;
     }
 
-    expand_heap(size + sizeof(heap_block_t));
-    return kmalloc(size);
+    if (align <= 8) {
+        return kmalloc(size);
+    }
+
+    // Объекты слабов выровнены по размеру своего класса
+    uint32_t class_size = size > align ? size : align;
+    if (class_size <= KMALLOC_MAX_CACHE_SIZE) {
+        void* obj = slab_kmalloc(class_size);
+        if (obj) {
+            return obj;
+        }
+    }
+
+    return heap_alloc_aligned(size, align);
 }
 
 void* kmalloc_a(uint32_t size) {
-    return kmalloc(size);
+    return kmalloc_align(size, PAGE_SIZE);
 }
 
-void* kmalloc_p(uint32_t size, uint32_t* phys) {
-    void* addr = kmalloc(size);
-    if (phys && addr) {
-        *phys = (uint32_t)addr;
+// Физический адрес начала блока; непрерывность гарантирована только
+// в пределах одной страницы, например для kmalloc_ap(size <= PAGE_SIZE).
+// Блок кучи отображается целиком сразу, чтобы адрес был действителен
+static void* with_phys(void* addr, uint32_t size, uint32_t* phys) {
+    if (addr == 0 || phys == 0) {
+        return addr;
     }
+
+    if (!slab_owns(addr) && !populate((uint32_t)addr, (uint32_t)addr + size)) {
+        kfree(addr);
+        return 0;
+    }
+
+    *phys = vmm_virt_to_phys((uint32_t)addr);
     return addr;
 }
 
+void* kmalloc_p(uint32_t size, uint32_t* phys) {
+    return with_phys(kmalloc(size), size, phys);
+}
+
+void* kmalloc_ap(uint32_t size, uint32_t* phys) {
+    return with_phys(kmalloc_a(size), size, phys);
+}
+
 void kfree(void* ptr) {
     if (!ptr) {
         return;
     }
 
+    if (slab_owns(ptr)) {
+        slab_kfree(ptr);
+        return;
+    }
+
+    if ((uint32_t)ptr < heap_start || (uint32_t)ptr >= heap_end) {
+        return;
+    }
+
     heap_block_t* block = (heap_block_t*)((uint32_t)ptr - sizeof(heap_block_t));
 
-    if (block->magic != HEAP_MAGIC) {
+    if (block->magic != HEAP_MAGIC || block_free(block)) {
         return;
     }
 
-    block->is_free = 1;
+    allocated_bytes -= block_size(block);
+    coalesce(block);
+
+    uint32_t free_now = free_resident();
+    if (free_now <= trim_high) {
+        trim_retry = 0;
+    } else if (free_now >= trim_retry) {
+        uint32_t before = resident_pages;
+        heap_trim();
+        trim_retry = resident_pages == before ? free_now + (trim_high - trim_low) : 0;
+    }
+}
 
-    if (block->next && block->next->is_free) {
-        block->size += sizeof(heap_block_t) + block->next->size;
-        block->next = block->next->next;
+void heap_trim(void) {
+    uint32_t resident = free_resident();
+    if (resident <= trim_low) {
+        return;
     }
-}
\ No newline at end of file
+    uint32_t budget = (resident - trim_low) >> 12;
+
+    // Сначала свободный хвост кучи: уменьшаем heap_end
+    uint32_t tag = *(uint32_t*)(heap_end - sizeof(heap_block_t) - sizeof(uint32_t));
+    if (tag & HEAP_FREE) {
+        heap_block_t* last = (heap_block_t*)(heap_end - sizeof(heap_block_t) - (tag & HEAP_SIZE_MASK));
+        uint32_t min_end = align_page((uint32_t)last + HEAP_MIN_BLOCK + sizeof(heap_block_t));
+        if (min_end < heap_start + HEAP_INITIAL_SIZE) {
+            min_end = heap_start + HEAP_INITIAL_SIZE;
+        }
+
+        uint32_t new_end = heap_end;
+        if (min_end < heap_end) {
+            uint32_t pages = (heap_end - min_end) >> 12;
+            new_end = heap_end - ((pages < budget ? pages : budget) << 12);
+        }
+
+        if (new_end < heap_end) {
+            bin_remove(last);
+
+            uint32_t released = release_range(new_end, heap_end, 0xFFFFFFFF);
+            budget = released < budget ? budget - released : 0;
+            heap_end = new_end;
+
+            block_write(last, new_end - sizeof(heap_block_t) - (uint32_t)last, HEAP_FREE);
+
+            heap_block_t* epilogue = (heap_block_t*)(new_end - sizeof(heap_block_t));
+            epilogue->magic = HEAP_MAGIC;
+            epilogue->size = 0;
+
+            bin_insert(last);
+        }
+    }
+
+    // Затем внутренние страницы больших свободных блоков, начиная с крупных.
+    // Первая страница с заголовком и ссылками корзины и последняя с
+    // граничным тегом остаются отображёнными
+    for (uint32_t i = HEAP_BINS; i-- > bin_index(HEAP_TRIM_MIN_BLOCK) && budget;) {
+        for (heap_block_t* block = bins[i]; block && budget; block = block_links(block)->next) {
+            uint32_t start = align_page((uint32_t)block + sizeof(heap_block_t) + sizeof(heap_free_links_t));
+            uint32_t end = (uint32_t)block_footer(block) & 0xFFFFF000;
+
+            if (block_size(block) < HEAP_TRIM_MIN_BLOCK || end <= start) {
+                continue;
+            }
+
+            budget -= release_range(start, end, budget);
+        }
+    }
+}
+
+void heap_set_trim(uint32_t high, uint32_t low) {
+    trim_high = high;
+    trim_low = low < high ? low : high;
+    trim_retry = 0;
+}
+
+void heap_get_stats(heap_stats_t* stats) {
+    stats->heap_size = heap_end - heap_start;
+    stats->resident = resident_pages << 12;
+    stats->free_bytes = 0;
+    stats->free_blocks = 0;
+    stats->largest_free = 0;
+
+    for (uint32_t i = 0; i < HEAP_BINS; i++) {
+        for (heap_block_t* block = bins[i]; block; block = block_links(block)->next) {
+            uint32_t size = block_size(block);
+            stats->free_bytes += size;
+            stats->free_blocks++;
+            if (size > stats->largest_free) {
+                stats->largest_free = size;
+            }
+        }
+    }
+}
+
+#define STRESS_SLOTS 512
+#define STRESS_WINDOWS 10
+
+void heap_stress_test(uint32_t ops) {
+    extern void kprint(const char*);
+    extern void kprint_dec(uint32_t);
+
+    static void* slots[STRESS_SLOTS];
+    static uint32_t sizes[STRESS_SLOTS];
+
+    uint32_t seed = 0x2545F491;
+    uint32_t window = ops / STRESS_WINDOWS;
+    if (window == 0) {
+        window = ops;
+    }
+
+    for (uint32_t i = 0; i < STRESS_SLOTS; i++) {
+        slots[i] = 0;
+    }
+
+    uint64_t alloc_cycles = 0, free_cycles = 0;
+    uint32_t alloc_ops = 0, free_ops = 0;
+    uint32_t alloc_max = 0, free_max = 0;
+    uint32_t failures = 0;
+
+    for (uint32_t op = 1; op <= ops; op++) {
+        seed = seed * 1664525 + 1013904223;
+        uint32_t slot = (seed >> 8) % STRESS_SLOTS;
+
+        if (slots[slot]) {
+            uint64_t start = rdtsc();
+            kfree(slots[slot]);
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+
+            slots[slot] = 0;
+            free_cycles += cycles;
+            free_ops++;
+            if (cycles > free_max) {
+                free_max = cycles;
+            }
+        } else {
+            // Размеры распределены логарифмически: от 8 байт до 32 КБ
+            seed = seed * 1664525 + 1013904223;
+            uint32_t size = (8U << ((seed >> 24) % 13)) + ((seed >> 4) & 0x3F);
+
+            uint64_t start = rdtsc();
+            void* ptr = kmalloc(size);
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+
+            if (ptr == 0) {
+                failures++;
+                continue;
+            }
+
+            *(uint32_t*)ptr = size;
+            slots[slot] = ptr;
+            sizes[slot] = size;
+            alloc_cycles += cycles;
+            alloc_ops++;
+            if (cycles > alloc_max) {
+                alloc_max = cycles;
+            }
+        }
+
+        if (op % window == 0) {
+            heap_stats_t stats;
+            heap_get_stats(&stats);
+
+            kprint_dec(op);
+            kprint(" ops: alloc avg ");
+            kprint_dec(alloc_ops ? (uint32_t)div64_u32(alloc_cycles, alloc_ops, 0) : 0);
+            kprint(" max ");
+            kprint_dec(alloc_max);
+            kprint(", free avg ");
+            kprint_dec(free_ops ? (uint32_t)div64_u32(free_cycles, free_ops, 0) : 0);
+            kprint(" max ");
+            kprint_dec(free_max);
+            kprint(" cycles, heap ");
+            kprint_dec(stats.heap_size / 1024);
+            kprint(" KB, frag ");
+            kprint_dec(stats.free_bytes ? 100 - (uint32_t)div64_u32((uint64_t)stats.largest_free * 100, stats.free_bytes, 0) : 0);
+            kprint("%\n");
+
+            alloc_cycles = free_cycles = 0;
+            alloc_ops = free_ops = 0;
+            alloc_max = free_max = 0;
+        }
+    }
+
+    uint32_t corrupted = 0;
+    for (uint32_t i = 0; i < STRESS_SLOTS; i++) {
+        if (slots[i]) {
+            if (*(uint32_t*)slots[i] != sizes[i]) {
+                corrupted++;
+            }
+            kfree(slots[i]);
+            slots[i] = 0;
+        }
+    }
+
+    heap_stats_t stats;
+    heap_get_stats(&stats);
+
+    kprint("Failed allocations: ");
+    kprint_dec(failures);
+    kprint(", corrupted blocks: ");
+    kprint_dec(corrupted);
+    kprint("\nAfter freeing all: ");
+    kprint_dec(stats.free_blocks);
+    kprint(" free block(s), largest ");
+    kprint_dec(stats.largest_free / 1024);
+    kprint(" KB of ");
+    kprint_dec(stats.heap_size / 1024);
+    kprint(" KB\n");
+}
@@ -3,11 +3,26 @@
 
 #include "../libc/stdint.h"
 
+typedef struct heap_stats {
+    uint32_t heap_size;
+    uint32_t resident;
+    uint32_t free_bytes;
+    uint32_t free_blocks;
+    uint32_t largest_free;
+} heap_stats_t;
+
 void heap_init(void);
 void* kmalloc(uint32_t size);
+void* kmalloc_align(uint32_t size, uint32_t align);
 void* kmalloc_a(uint32_t size);
 void* kmalloc_p(uint32_t size, uint32_t* phys);
 void* kmalloc_ap(uint32_t size, uint32_t* phys);
 void kfree(void* ptr);
 
-#endif
\ No newline at end of file
+void heap_trim(void);
+void heap_set_trim(uint32_t high, uint32_t low);
+
+void heap_get_stats(heap_stats_t* stats);
+void heap_stress_test(uint32_t ops);
+
+#endif
@@ -1,19 +1,62 @@
 #include "pmm.h"
 
-static uint32_t* page_bitmap = (uint32_t*)0x10000;
+extern uint32_t kernel_end;
+
+typedef struct pmm_region {
+    uint32_t first;
+    uint32_t end;
+} pmm_region_t;
+
+static uint32_t* page_bitmap = 0;
 static uint32_t total_pages = 0;
-static uint32_t used_pages = 0;
+static uint32_t usable_pages = 0;
+static uint32_t free_pages = 0;
+static uint32_t bitmap_words = 0;
+
+static pmm_region_t regions[PMM_MAX_REGIONS];
+static uint32_t region_count = 0;
+
+// Бит w установлен, если в page_bitmap[w] есть хотя бы одна свободная страница
+static uint32_t page_summary[PMM_SUMMARY_WORDS];
+static uint32_t summary_words = 0;
+static uint32_t next_free_word = 0;
+
+// Свободные блоки порядка k: бит i означает, что блок со страницы i << k свободен
+typedef struct buddy_map {
+    uint32_t* bits;
+    uint32_t* summary;
+    uint32_t blocks;
+    uint32_t words;
+    uint32_t summary_words;
+    uint32_t free_blocks;
+} buddy_map_t;
+
+static buddy_map_t buddy[PMM_MAX_ORDER + 1];
+static uint32_t* meta_end = 0;
+
+// Число дополнительных владельцев кадра (0 - кадр принадлежит одному)
+static uint16_t* page_refs = 0;
+
+static inline void summary_update(uint32_t index) {
+    if (page_bitmap[index] != 0xFFFFFFFF) {
+        page_summary[index >> 5] |= (1U << (index & 31));
+    } else {
+        page_summary[index >> 5] &= ~(1U << (index & 31));
+    }
+}
 
 static inline void bitmap_set(uint32_t page) {
     uint32_t index = page >> 5;
     uint32_t bit = page & 31;
     page_bitmap[index] |= (1U << bit);
+    summary_update(index);
 }
 
 static inline void bitmap_clear(uint32_t page) {
     uint32_t index = page >> 5;
     uint32_t bit = page & 31;
     page_bitmap[index] &= ~(1U << bit);
+    page_summary[index >> 5] |= (1U << (index & 31));
 }
 
 static inline int bitmap_test(uint32_t page) {
@@ -22,61 +65,447 @@ static inline int bitmap_test(uint32_t page) {
     return page_bitmap[index] & (1U << bit);
 }
 
-void pmm_init(uint32_t mem_size) {
-    total_pages = mem_size >> 12;
-    used_pages = 0;
+static void bitmap_set_range(uint32_t first, uint32_t count) {
+    uint32_t page = first;
+    uint32_t end = first + count;
+
+    while (page < end) {
+        uint32_t index = page >> 5;
+        uint32_t bit = page & 31;
+        uint32_t n = 32 - bit;
+        if (n > end - page) {
+            n = end - page;
+        }
+
+        uint32_t mask = (n == 32) ? 0xFFFFFFFF : (((1U << n) - 1) << bit);
+        page_bitmap[index] |= mask;
+        summary_update(index);
+        page += n;
+    }
+}
+
+static void bitmap_clear_range(uint32_t first, uint32_t count) {
+    uint32_t page = first;
+    uint32_t end = first + count;
+
+    while (page < end) {
+        uint32_t index = page >> 5;
+        uint32_t bit = page & 31;
+        uint32_t n = 32 - bit;
+        if (n > end - page) {
+            n = end - page;
+        }
+
+        uint32_t mask = (n == 32) ? 0xFFFFFFFF : (((1U << n) - 1) << bit);
+        page_bitmap[index] &= ~mask;
+        page_summary[index >> 5] |= (1U << (index & 31));
+        page += n;
+    }
+}
+
+static int32_t find_free_word(uint32_t start) {
+    uint32_t s = start >> 5;
+    uint32_t mask = page_summary[s] & (0xFFFFFFFF << (start & 31));
+
+    for (uint32_t i = 0; i <= summary_words; i++) {
+        if (mask) {
+            return (int32_t)((s << 5) + __builtin_ctz(mask));
+        }
+
+        s++;
+        if (s == summary_words) {
+            s = 0;
+        }
+        mask = page_summary[s];
+    }
+
+    return -1;
+}
+
+static inline int buddy_test(uint32_t order, uint32_t block) {
+    return buddy[order].bits[block >> 5] & (1U << (block & 31));
+}
+
+static inline void buddy_set(uint32_t order, uint32_t block) {
+    buddy_map_t* map = &buddy[order];
+    uint32_t index = block >> 5;
+
+    map->bits[index] |= (1U << (block & 31));
+    map->summary[index >> 5] |= (1U << (index & 31));
+    map->free_blocks++;
+}
+
+static inline void buddy_clear(uint32_t order, uint32_t block) {
+    buddy_map_t* map = &buddy[order];
+    uint32_t index = block >> 5;
+
+    map->bits[index] &= ~(1U << (block & 31));
+    if (map->bits[index] == 0) {
+        map->summary[index >> 5] &= ~(1U << (index & 31));
+    }
+    map->free_blocks--;
+}
+
+static int32_t buddy_find(uint32_t order) {
+    buddy_map_t* map = &buddy[order];
+
+    for (uint32_t s = 0; s < map->summary_words; s++) {
+        if (map->summary[s]) {
+            uint32_t index = (s << 5) + __builtin_ctz(map->summary[s]);
+            return (int32_t)((index << 5) + __builtin_ctz(map->bits[index]));
+        }
+    }
+
+    return -1;
+}
+
+// Возвращает блок в систему двойников, сливая его с соседями
+static void buddy_insert(uint32_t page, uint32_t order) {
+    uint32_t block = page >> order;
+
+    while (order < PMM_MAX_ORDER) {
+        uint32_t pair = block ^ 1;
+        if (pair >= buddy[order].blocks || !buddy_test(order, pair)) {
+            break;
+        }
+
+        buddy_clear(order, pair);
+        block >>= 1;
+        order++;
+    }
+
+    buddy_set(order, block);
+}
+
+// Изымает одну страницу из свободного блока, расщепляя его до порядка 0
+static void buddy_take_page(uint32_t page) {
+    uint32_t order = 0;
+
+    while (order <= PMM_MAX_ORDER) {
+        uint32_t block = page >> order;
+        if (block < buddy[order].blocks && buddy_test(order, block)) {
+            break;
+        }
+        order++;
+    }
+
+    if (order > PMM_MAX_ORDER) {
+        return;
+    }
+
+    buddy_clear(order, page >> order);
+
+    while (order > 0) {
+        order--;
+        buddy_set(order, (page >> order) ^ 1);
+    }
+}
+
+static uint32_t* meta_carve(uint32_t words) {
+    uint32_t* area = meta_end;
+    for (uint32_t i = 0; i < words; i++) {
+        area[i] = 0;
+    }
+    meta_end += words;
+    return area;
+}
+
+static void buddy_init(void) {
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        buddy_map_t* map = &buddy[order];
+
+        map->blocks = total_pages >> order;
+        map->words = (map->blocks + 31) >> 5;
+        map->summary_words = (map->words + 31) >> 5;
+        map->free_blocks = 0;
+        map->bits = meta_carve(map->words);
+        map->summary = meta_carve(map->summary_words);
+    }
+}
+
+static uint32_t meta_size(void) {
+    uint32_t words = bitmap_words + ((total_pages + 1) >> 1);
+
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        uint32_t order_words = ((total_pages >> order) + 31) >> 5;
+        words += order_words + ((order_words + 31) >> 5);
+    }
+
+    return words << 2;
+}
+
+static void buddy_populate(void) {
+    for (uint32_t page = 0; page < total_pages; page++) {
+        if (!bitmap_test(page)) {
+            buddy_insert(page, 0);
+        }
+    }
+}
+
+static void add_region(uint64_t addr, uint64_t len) {
+    if (region_count >= PMM_MAX_REGIONS || len == 0 || addr >= 0x100000000ULL) {
+        return;
+    }
+
+    uint64_t end = addr + len;
+    if (end > 0x100000000ULL) {
+        end = 0x100000000ULL;
+    }
+
+    // Берём только целые страницы внутри региона
+    uint32_t first = (uint32_t)((addr + 0xFFF) >> 12);
+    uint32_t last = (uint32_t)(end >> 12);
+    if (last > PMM_MAX_PAGES) {
+        last = PMM_MAX_PAGES;
+    }
+    if (last <= first) {
+        return;
+    }
+
+    regions[region_count].first = first;
+    regions[region_count].end = last;
+    region_count++;
+}
+
+static void collect_regions(multiboot_info_t* mboot) {
+    region_count = 0;
+
+    if (mboot->flags & MULTIBOOT_INFO_MEM_MAP) {
+        uint32_t addr = mboot->mmap_addr;
+        uint32_t end = mboot->mmap_addr + mboot->mmap_length;
+
+        while (addr < end) {
+            multiboot_mmap_entry_t* entry = (multiboot_mmap_entry_t*)addr;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                add_region(entry->addr, entry->len);
+            }
+            addr += entry->size + sizeof(entry->size);
+        }
+    } else if (mboot->flags & MULTIBOOT_INFO_MEMORY) {
+        add_region(0, (uint64_t)mboot->mem_lower * 1024);
+        add_region(0x100000, (uint64_t)mboot->mem_upper * 1024);
+    }
+}
+
+// Метаданные кладём в первый доступный участок после ядра.
+// Он должен оставаться в пределах тождественного отображения vmm_init.
+static uint32_t place_metadata(uint32_t size) {
+    uint32_t start = (((uint32_t)&kernel_end) + 0xFFF) >> 12;
+    uint32_t pages = (size + 0xFFF) >> 12;
+    uint32_t best = 0;
+
+    for (uint32_t i = 0; i < region_count; i++) {
+        uint32_t first = regions[i].first > start ? regions[i].first : start;
+        if (first + pages <= regions[i].end && (best == 0 || first < best)) {
+            best = first;
+        }
+    }
+
+    return best ? best : start;
+}
+
+void pmm_init(multiboot_info_t* mboot) {
+    // Карта памяти загрузчика может лежать там, куда попадут метаданные,
+    // поэтому сначала копируем доступные регионы
+    collect_regions(mboot);
+
+    total_pages = 0;
+    for (uint32_t i = 0; i < region_count; i++) {
+        if (regions[i].end > total_pages) {
+            total_pages = regions[i].end;
+        }
+    }
+
+    bitmap_words = (total_pages + 31) >> 5;
+    summary_words = (bitmap_words + 31) >> 5;
+    next_free_word = 0;
 
-    uint32_t bitmap_size = (total_pages >> 5) + 1;
-    for (uint32_t i = 0; i < bitmap_size; i++) {
-        page_bitmap[i] = 0;
+    page_bitmap = (uint32_t*)(place_metadata(meta_size()) << 12);
+
+    // Изначально вся память занята; освобождаем только доступные регионы
+    for (uint32_t i = 0; i < bitmap_words; i++) {
+        page_bitmap[i] = 0xFFFFFFFF;
+    }
+    for (uint32_t i = 0; i < PMM_SUMMARY_WORDS; i++) {
+        page_summary[i] = 0;
     }
 
-    // Зарезервируем страницы под ядро и область битовой карты
-    uint32_t kernel_pages = (0x100000 + 0x400000) >> 12;
-    
-    // Резервируем также память под саму битовую карту
-    uint32_t bitmap_pages = ((bitmap_size << 2) + 0xFFF) >> 12;
-    uint32_t bitmap_start_page = ((uint32_t)page_bitmap) >> 12;
-    
-    for (uint32_t i = 0; i < kernel_pages; i++) {
-        if (i < total_pages) {
-            bitmap_set(i);
-            used_pages++;
+    meta_end = page_bitmap + bitmap_words;
+    page_refs = (uint16_t*)meta_carve((total_pages + 1) >> 1);
+    buddy_init();
+
+    usable_pages = 0;
+    for (uint32_t i = 0; i < region_count; i++) {
+        for (uint32_t page = regions[i].first; page < regions[i].end; page++) {
+            if (bitmap_test(page)) {
+                bitmap_clear(page);
+                usable_pages++;
+            }
         }
     }
-    
-    // Резервируем страницы под битовую карту
-    for (uint32_t i = bitmap_start_page; i < bitmap_start_page + bitmap_pages; i++) {
-        if (i < total_pages) {
-            bitmap_set(i);
-            used_pages++;
+    free_pages = usable_pages;
+
+    // Резервируем нижний мегабайт, образ ядра и метаданные PMM
+    uint32_t reserved_end = ((uint32_t)meta_end + 0xFFF) >> 12;
+    for (uint32_t page = 0; page < reserved_end && page < total_pages; page++) {
+        if (!bitmap_test(page)) {
+            bitmap_set(page);
+            free_pages--;
         }
     }
+
+    buddy_populate();
 }
 
 uint32_t pmm_alloc_page(void) {
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if(!bitmap_test(i)) {
-            bitmap_set(i);
-            used_pages++;
-            return i << 12;
+    if (free_pages == 0) {
+        return 0;
+    }
+
+    int32_t index = find_free_word(next_free_word);
+    if (index < 0) {
+        return 0;
+    }
+
+    uint32_t bit = __builtin_ctz(~page_bitmap[index]);
+    uint32_t page = ((uint32_t)index << 5) + bit;
+
+    page_bitmap[index] |= (1U << bit);
+    summary_update(index);
+    buddy_take_page(page);
+
+    free_pages--;
+    next_free_word = index;
+
+    return page << 12;
+}
+
+uint32_t pmm_alloc_pages(uint32_t* pages, uint32_t count) {
+    uint32_t done = 0;
+
+    while (done < count && free_pages > 0) {
+        int32_t index = find_free_word(next_free_word);
+        if (index < 0) {
+            break;
+        }
+
+        uint32_t free = ~page_bitmap[index];
+        uint32_t taken = 0;
+
+        while (free && done < count) {
+            uint32_t bit = __builtin_ctz(free);
+            uint32_t page = ((uint32_t)index << 5) + bit;
+
+            free &= free - 1;
+            taken |= (1U << bit);
+            buddy_take_page(page);
+            pages[done++] = page << 12;
+            free_pages--;
         }
+
+        page_bitmap[index] |= taken;
+        summary_update(index);
+
+        next_free_word = index;
     }
-    return 0;
+
+    return done;
 }
 
 void pmm_free_page(uint32_t page) {
     uint32_t page_num = page >> 12;
+    if (page_num >= total_pages) {
+        return;
+    }
+
     if (bitmap_test(page_num)) {
+        // Общий кадр освобождается только последним владельцем
+        if (page_refs[page_num]) {
+            page_refs[page_num]--;
+            return;
+        }
         bitmap_clear(page_num);
-        used_pages--;
+        buddy_insert(page_num, 0);
+        free_pages++;
+    }
+}
+
+void pmm_ref_page(uint32_t page) {
+    uint32_t page_num = page >> 12;
+    if (page_num < total_pages && bitmap_test(page_num) && page_refs[page_num] < 0xFFFF) {
+        page_refs[page_num]++;
+    }
+}
+
+uint32_t pmm_page_refs(uint32_t page) {
+    uint32_t page_num = page >> 12;
+    if (page_num >= total_pages || !bitmap_test(page_num)) {
+        return 0;
+    }
+    return page_refs[page_num] + 1U;
+}
+
+uint32_t pmm_alloc_order(uint32_t order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
     }
+
+    uint32_t found = order;
+    while (found <= PMM_MAX_ORDER && buddy[found].free_blocks == 0) {
+        found++;
+    }
+    if (found > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    int32_t block = buddy_find(found);
+    if (block < 0) {
+        return 0;
+    }
+
+    uint32_t index = (uint32_t)block;
+    buddy_clear(found, index);
+
+    // Расщепляем блок, возвращая правые половины на уровень ниже
+    while (found > order) {
+        found--;
+        index <<= 1;
+        buddy_set(found, index + 1);
+    }
+
+    uint32_t page = index << order;
+    bitmap_set_range(page, 1U << order);
+    free_pages -= 1U << order;
+
+    return page << 12;
+}
+
+void pmm_free_order(uint32_t addr, uint32_t order) {
+    uint32_t page = addr >> 12;
+
+    if (order > PMM_MAX_ORDER || (page & ((1U << order) - 1))) {
+        return;
+    }
+    if (page + (1U << order) > total_pages || !bitmap_test(page)) {
+        return;
+    }
+
+    bitmap_clear_range(page, 1U << order);
+    buddy_insert(page, order);
+    free_pages += 1U << order;
+}
+
+uint32_t pmm_get_free_blocks(uint32_t order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+    return buddy[order].free_blocks;
 }
 
 uint32_t pmm_get_total_memory(void) {
-    return total_pages << 12;
+    return usable_pages << 12;
 }
 
 uint32_t pmm_get_free_memory(void) {
-    return (total_pages - used_pages) << 12;
-}
\ No newline at end of file
+    return free_pages << 12;
+}
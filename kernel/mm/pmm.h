@@ -2,14 +2,26 @@
 #define PMM_H
 
 #include "../libc/stdint.h"
+#include "../multiboot.h"
 
 #define PAGE_SIZE 4096
 #define PAGES_PER_BYTE 8
 
-void pmm_init(uint32_t mem_size);
+#define PMM_MAX_PAGES 0x100000
+#define PMM_SUMMARY_WORDS (PMM_MAX_PAGES >> 10)
+#define PMM_MAX_ORDER 10
+#define PMM_MAX_REGIONS 32
+
+void pmm_init(multiboot_info_t* mboot);
 uint32_t pmm_alloc_page(void);
+uint32_t pmm_alloc_pages(uint32_t* pages, uint32_t count);
 void pmm_free_page(uint32_t page);
+void pmm_ref_page(uint32_t page);
+uint32_t pmm_page_refs(uint32_t page);
+uint32_t pmm_alloc_order(uint32_t order);
+void pmm_free_order(uint32_t addr, uint32_t order);
+uint32_t pmm_get_free_blocks(uint32_t order);
 uint32_t pmm_get_total_memory(void);
 uint32_t pmm_get_free_memory(void);
 
-#endif
\ No newline at end of file
+#endif
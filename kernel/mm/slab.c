@@ -0,0 +1,254 @@
+#include "slab.h"
+#include "pmm.h"
+#include "vmm.h"
+
+// Дескриптор каждой страницы окна слабов лежит вне самой страницы,
+// поэтому объект находит свой слаб по адресу за O(1)
+static kmem_slab_t slab_descs[SLAB_WINDOW_PAGES];
+static kmem_slab_t* slab_free_descs = 0;
+static uint32_t slab_top = 0;
+
+static kmem_cache_t cache_cache;
+static kmem_cache_t* cache_list = 0;
+static kmem_cache_t* kmalloc_caches[KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1];
+
+static const char* kmalloc_names[] = {
+    "kmalloc-16",
+    "kmalloc-32",
+    "kmalloc-64",
+    "kmalloc-128",
+    "kmalloc-256",
+    "kmalloc-512",
+    "kmalloc-1024",
+    "kmalloc-2048",
+};
+
+static inline uint32_t slab_addr(kmem_slab_t* slab) {
+    return SLAB_START + ((uint32_t)(slab - slab_descs) << 12);
+}
+
+static inline kmem_slab_t* slab_of(const void* obj) {
+    return &slab_descs[((uint32_t)obj - SLAB_START) >> 12];
+}
+
+static void slab_list_add(kmem_slab_t** head, kmem_slab_t* slab) {
+    slab->prev = 0;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(kmem_slab_t** head, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+static kmem_slab_t* slab_grow(kmem_cache_t* cache) {
+    kmem_slab_t* slab;
+
+    if (slab_free_descs) {
+        slab = slab_free_descs;
+        slab_free_descs = slab->next;
+    } else if (slab_top < SLAB_WINDOW_PAGES) {
+        slab = &slab_descs[slab_top++];
+    } else {
+        return 0;
+    }
+
+    uint32_t phys = pmm_alloc_page();
+    if (phys == 0) {
+        slab->next = slab_free_descs;
+        slab_free_descs = slab;
+        return 0;
+    }
+
+    uint32_t addr = slab_addr(slab);
+    vmm_map_page(addr, phys, PAGE_PRESENT | PAGE_WRITE);
+
+    slab->cache = cache;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->inuse = 0;
+    slab->phys = phys;
+
+    // Связываем все объекты страницы в список свободных
+    slab->free = (void*)addr;
+    for (uint32_t i = 0; i < cache->per_slab; i++) {
+        uint32_t obj = addr + i * cache->size;
+        *(uint32_t*)obj = (i + 1 < cache->per_slab) ? obj + cache->size : 0;
+    }
+
+    cache->slab_count++;
+    return slab;
+}
+
+static void slab_release(kmem_slab_t* slab) {
+    kmem_cache_t* cache = slab->cache;
+
+    vmm_unmap_page(slab_addr(slab));
+    pmm_free_page(slab->phys);
+
+    cache->slab_count--;
+
+    slab->cache = 0;
+    slab->free = 0;
+    slab->prev = 0;
+    slab->next = slab_free_descs;
+    slab_free_descs = slab;
+}
+
+static void cache_setup(kmem_cache_t* cache, const char* name, uint32_t size, uint32_t align) {
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+
+    cache->name = name;
+    cache->object_size = size;
+    cache->align = align;
+    cache->size = (size + align - 1) & ~(align - 1);
+    cache->per_slab = PAGE_SIZE / cache->size;
+    cache->partial = 0;
+    cache->empty = 0;
+    cache->empty_count = 0;
+    cache->slab_count = 0;
+    cache->active = 0;
+
+    cache->next = cache_list;
+    cache_list = cache;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align) {
+    if (align & (align - 1)) {
+        return 0;
+    }
+
+    uint32_t stride = size < sizeof(void*) ? sizeof(void*) : size;
+    if (align > 1) {
+        stride = (stride + align - 1) & ~(align - 1);
+    }
+    if (stride > PAGE_SIZE) {
+        return 0;
+    }
+
+    kmem_cache_t* cache = (kmem_cache_t*)kmem_cache_alloc(&cache_cache);
+    if (cache == 0) {
+        return 0;
+    }
+
+    cache_setup(cache, name, size, align);
+    return cache;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    kmem_slab_t* slab = cache->partial;
+
+    if (slab == 0) {
+        slab = cache->empty;
+        if (slab) {
+            slab_list_remove(&cache->empty, slab);
+            cache->empty_count--;
+        } else {
+            slab = slab_grow(cache);
+            if (slab == 0) {
+                return 0;
+            }
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    void* obj = slab->free;
+    slab->free = *(void**)obj;
+    slab->inuse++;
+    cache->active++;
+
+    // Заполненный слаб не хранится ни в одном списке
+    if (slab->inuse == cache->per_slab) {
+        slab_list_remove(&cache->partial, slab);
+    }
+
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (obj == 0 || !slab_owns(obj)) {
+        return;
+    }
+
+    kmem_slab_t* slab = slab_of(obj);
+    if (slab->cache != cache) {
+        return;
+    }
+
+    if (slab->inuse == cache->per_slab) {
+        slab_list_add(&cache->partial, slab);
+    }
+
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    slab->inuse--;
+    cache->active--;
+
+    if (slab->inuse == 0) {
+        slab_list_remove(&cache->partial, slab);
+
+        if (cache->empty_count < SLAB_EMPTY_KEEP) {
+            slab_list_add(&cache->empty, slab);
+            cache->empty_count++;
+        } else {
+            slab_release(slab);
+        }
+    }
+}
+
+kmem_cache_t* kmem_cache_list(void) {
+    return cache_list;
+}
+
+void* slab_kmalloc(uint32_t size) {
+    uint32_t index = 0;
+    if (size > (1U << KMALLOC_MIN_SHIFT)) {
+        index = (32 - __builtin_clz(size - 1)) - KMALLOC_MIN_SHIFT;
+    }
+
+    if (size > KMALLOC_MAX_CACHE_SIZE || kmalloc_caches[index] == 0) {
+        return 0;
+    }
+
+    return kmem_cache_alloc(kmalloc_caches[index]);
+}
+
+void slab_kfree(void* ptr) {
+    kmem_slab_t* slab = slab_of(ptr);
+    if (slab->cache) {
+        kmem_cache_free(slab->cache, ptr);
+    }
+}
+
+void slab_init(void) {
+    slab_free_descs = 0;
+    slab_top = 0;
+    cache_list = 0;
+
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), sizeof(void*));
+
+    // Степени двойки, выровненные по своему размеру: от 64 байт объекты
+    // занимают целые строки кэша
+    for (uint32_t shift = KMALLOC_MIN_SHIFT; shift <= KMALLOC_MAX_SHIFT; shift++) {
+        uint32_t size = 1U << shift;
+        kmalloc_caches[shift - KMALLOC_MIN_SHIFT] =
+            kmem_cache_create(kmalloc_names[shift - KMALLOC_MIN_SHIFT], size, size);
+    }
+}
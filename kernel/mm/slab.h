@@ -0,0 +1,55 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "../libc/stdint.h"
+
+#define SLAB_START 0xD0000000
+#define SLAB_WINDOW_SIZE 0x01000000
+#define SLAB_WINDOW_PAGES (SLAB_WINDOW_SIZE >> 12)
+
+#define SLAB_EMPTY_KEEP 1
+
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_MAX_SHIFT 11
+#define KMALLOC_MAX_CACHE_SIZE (1U << KMALLOC_MAX_SHIFT)
+
+struct kmem_cache;
+
+typedef struct kmem_slab {
+    struct kmem_cache* cache;
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+    void* free;
+    uint32_t inuse;
+    uint32_t phys;
+} kmem_slab_t;
+
+typedef struct kmem_cache {
+    const char* name;
+    uint32_t object_size;
+    uint32_t size;
+    uint32_t align;
+    uint32_t per_slab;
+    kmem_slab_t* partial;
+    kmem_slab_t* empty;
+    uint32_t empty_count;
+    uint32_t slab_count;
+    uint32_t active;
+    struct kmem_cache* next;
+} kmem_cache_t;
+
+void slab_init(void);
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+kmem_cache_t* kmem_cache_list(void);
+
+void* slab_kmalloc(uint32_t size);
+void slab_kfree(void* ptr);
+
+static inline int slab_owns(const void* ptr) {
+    return (uint32_t)ptr >= SLAB_START && (uint32_t)ptr < SLAB_START + SLAB_WINDOW_SIZE;
+}
+
+#endif
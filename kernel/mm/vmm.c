@@ -3,29 +3,189 @@
 #include "../cpu/isr.h"
 #include "../libc/stdint.h"
 #include "../libc/string.h"
+#include "../cpu/tsc.h"
+#include "../cpu/cpuid.h"
+
+#define VMM_IDENTITY_SIZE 0x800000
+#define VMM_INVLPG_MAX 32
+#define VMM_BENCH_BASE 0xE0000000
+#define VMM_BENCH_PAGES 256
+#define VMM_COW_TEST_ADDR 0x40000000
+
+// Последняя PDE указывает на сам каталог: таблица страниц i видна по
+// адресу VMM_PAGE_TABLES + i * 4096, а каталог - по VMM_PAGE_DIR
+#define VMM_RECURSIVE_SLOT 1023
+#define VMM_TEMP_PD_SLOT 1022
+#define VMM_PAGE_TABLES 0xFFC00000
+#define VMM_PAGE_DIR 0xFFFFF000
+#define VMM_PD ((page_directory_t*)VMM_PAGE_DIR)
 
 static page_directory_t* kernel_directory = 0;
 static page_directory_t* current_directory = 0;
+static int pse_enabled = 0;
+static int pge_enabled = 0;
+
+// Клон копирует PDE ядра и не узнаёт об их замене, поэтому после
+// первого клонирования 4 МБ страниц в общей части ядра больше нет
+static int directories_cloned = 0;
+
+typedef struct vmm_fault_region {
+    uint32_t start;
+    uint32_t end;
+    vmm_fault_handler_t handler;
+} vmm_fault_region_t;
+
+static vmm_fault_region_t fault_regions[VMM_MAX_FAULT_REGIONS];
+static uint32_t fault_region_count = 0;
+
+// Таблица окна временных отображений лежит в BSS ядра
+static page_table_t temp_table __attribute__((aligned(4096)));
+
+static inline page_table_t* table_at(uint32_t pd_index) {
+    return (page_table_t*)(VMM_PAGE_TABLES + (pd_index << 12));
+}
+
+// Тождественная область и всё выше VMM_KERNEL_BASE общие для всех каталогов
+static inline int kernel_pde(uint32_t pd_index) {
+    return pd_index < (VMM_IDENTITY_SIZE >> 22) || pd_index >= (VMM_KERNEL_BASE >> 22);
+}
+
+// Новые PDE ядра пишутся и в эталонный каталог, откуда остальные
+// подхватывают их при первом обращении
+static inline void set_pde(uint32_t pd_index, pde_t pde) {
+    VMM_PD->entries[pd_index] = pde;
+    if (kernel_pde(pd_index)) {
+        kernel_directory->entries[pd_index] = pde;
+    }
+}
+
+static inline pde_t sync_pde(uint32_t pd_index) {
+    pde_t pde = VMM_PD->entries[pd_index];
+    if (!(pde & PAGE_PRESENT) && kernel_pde(pd_index) &&
+        (kernel_directory->entries[pd_index] & PAGE_PRESENT)) {
+        pde = kernel_directory->entries[pd_index];
+        VMM_PD->entries[pd_index] = pde;
+    }
+    return pde;
+}
+
+static inline void flush_tlb(void) {
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r" (cr3));
+    asm volatile("mov %0, %%cr3" : : "r" (cr3) : "memory");
+}
+
+// Глобальные записи переживают перезагрузку CR3, их сбрасывает
+// только переключение CR4.PGE
+static inline void flush_tlb_global(void) {
+    if (!pge_enabled) {
+        flush_tlb();
+        return;
+    }
+
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
+    asm volatile("mov %0, %%cr4" : : "r" (cr4 & ~0x80) : "memory");
+    asm volatile("mov %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+static inline void invlpg(uint32_t virt) {
+    asm volatile("invlpg (%0)" : : "r" (virt) : "memory");
+}
+
+// Для коротких диапазонов дешевле invlpg по каждой странице,
+// для длинных - одна перезагрузка CR3
+static void flush_range(uint32_t virt, uint32_t npages, int global) {
+    if (npages > VMM_INVLPG_MAX) {
+        if (global) {
+            flush_tlb_global();
+        } else {
+            flush_tlb();
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < npages; i++) {
+        invlpg(virt + i * PAGE_SIZE);
+    }
+}
+
+// Отображает кадр в слот окна временных отображений; слот занят до
+// vmm_temp_unmap, у каждого пользователя окна свой номер
+void* vmm_temp_map(uint32_t slot, uint32_t phys) {
+    uint32_t virt = VMM_TEMP_BASE + slot * PAGE_SIZE;
+    temp_table.entries[slot] = (phys & 0xFFFFF000) | PAGE_PRESENT | PAGE_WRITE;
+    invlpg(virt);
+    return (void*)virt;
+}
+
+void vmm_temp_unmap(uint32_t slot) {
+    temp_table.entries[slot] = 0;
+    invlpg(VMM_TEMP_BASE + slot * PAGE_SIZE);
+}
+
+// Разбивает 4 МБ страницу на таблицу из 1024 обычных с теми же
+// отображениями, поэтому сбрасывать TLB здесь не нужно. Таблица
+// заполняется через временное окно до установки PDE: код и стек
+// могут лежать в разбиваемой области
+static page_table_t* split_large(uint32_t pd_index) {
+    pde_t pde = VMM_PD->entries[pd_index];
+
+    uint32_t phys = pmm_alloc_page();
+    if (phys == 0) {
+        return 0;
+    }
+
+    page_table_t* table = (page_table_t*)vmm_temp_map(VMM_TEMP_SPLIT, phys);
+    uint32_t base = pde & 0xFFC00000;
+    uint32_t flags = pde & (PAGE_PRESENT | PAGE_WRITE | PAGE_USER | PAGE_GLOBAL);
+
+    for (int i = 0; i < 1024; i++) {
+        table->entries[i] = (base + i * PAGE_SIZE) | flags;
+    }
+    vmm_temp_unmap(VMM_TEMP_SPLIT);
+
+    set_pde(pd_index, phys | (pde & (PAGE_PRESENT | PAGE_WRITE | PAGE_USER)));
+    invlpg((uint32_t)table_at(pd_index));
+    return table_at(pd_index);
+}
+
+// Разбивает все 4 МБ PDE ядра до того, как их скопирует первый клон:
+// дальше меняются только общие таблицы страниц, и клоны это видят
+static int split_kernel_large(void) {
+    for (uint32_t i = 0; i < VMM_RECURSIVE_SLOT; i++) {
+        if (!kernel_pde(i)) {
+            continue;
+        }
+
+        pde_t pde = sync_pde(i);
+        if ((pde & PAGE_PRESENT) && (pde & PAGE_LARGE) && split_large(i) == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
 
 static page_table_t* vmm_get_page_table(uint32_t virt, int create) {
     uint32_t pd_index = virt >> 22;
+    pde_t pde = sync_pde(pd_index);
 
-    if (current_directory->entries[pd_index] & PAGE_PRESENT) {
-        uint32_t table_phys = current_directory->entries[pd_index] & 0xFFFFF000;
-        return (page_table_t*)table_phys;
+    if (pde & PAGE_PRESENT) {
+        if (pde & PAGE_LARGE) {
+            return split_large(pd_index);
+        }
+        return table_at(pd_index);
     } else if (create) {
         uint32_t phys = pmm_alloc_page();
         if (phys == 0) {
             return 0;
         }
 
-        current_directory->entries[pd_index] = phys | PAGE_PRESENT | PAGE_WRITE;
+        set_pde(pd_index, phys | PAGE_PRESENT | PAGE_WRITE);
 
-        page_table_t* table = (page_table_t*)phys;
-        
-        for (int i = 0; i < 1024; i++) {
-            table->entries[i] = 0;
-        }
+        page_table_t* table = table_at(pd_index);
+        invlpg((uint32_t)table);
+        memset(table, 0, PAGE_SIZE);
 
         return table;
     }
@@ -33,10 +193,78 @@ static page_table_t* vmm_get_page_table(uint32_t virt, int create) {
     return 0;
 }
 
+int vmm_register_fault_handler(uint32_t start, uint32_t end, vmm_fault_handler_t handler) {
+    if (fault_region_count >= VMM_MAX_FAULT_REGIONS) {
+        return -1;
+    }
+
+    fault_regions[fault_region_count].start = start;
+    fault_regions[fault_region_count].end = end;
+    fault_regions[fault_region_count].handler = handler;
+    fault_region_count++;
+    return 0;
+}
+
+// Запись в страницу с PAGE_COW: единственный владелец просто получает
+// право записи, иначе кадр копируется
+static int cow_fault(uint32_t addr) {
+    pde_t pde = sync_pde(addr >> 22);
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+
+    pte_t* entry = &((pte_t*)VMM_PAGE_TABLES)[addr >> 12];
+    if (!(*entry & PAGE_COW)) {
+        return 0;
+    }
+
+    uint32_t page = addr & 0xFFFFF000;
+    uint32_t frame = *entry & 0xFFFFF000;
+    uint32_t flags = (*entry & 0xFFF & ~PAGE_COW) | PAGE_WRITE;
+
+    if (pmm_page_refs(frame) > 1) {
+        uint32_t copy = pmm_alloc_page();
+        if (copy == 0) {
+            return 0;
+        }
+
+        memcpy(vmm_temp_map(VMM_TEMP_COPY, copy), (void*)page, PAGE_SIZE);
+        vmm_temp_unmap(VMM_TEMP_COPY);
+
+        pmm_free_page(frame);
+        frame = copy;
+    }
+
+    *entry = frame | flags;
+    invlpg(page);
+    return 1;
+}
+
 static void page_fault_handler(registers_t* regs) {
     uint32_t faulting_address;
     asm volatile("mov %%cr2, %0" : "=r" (faulting_address));
 
+    if ((regs->err_code & 0x3) == 0x3 && cow_fault(faulting_address)) {
+        return;
+    }
+
+    // PDE ядра, появившаяся после клонирования каталога
+    uint32_t pd_index = faulting_address >> 22;
+    if (!(regs->err_code & 0x1) && !(VMM_PD->entries[pd_index] & PAGE_PRESENT) &&
+        (sync_pde(pd_index) & PAGE_PRESENT)) {
+        return;
+    }
+
+    // Владелец области может подставить страницу и продолжить выполнение
+    for (uint32_t i = 0; i < fault_region_count; i++) {
+        if (faulting_address >= fault_regions[i].start && faulting_address < fault_regions[i].end) {
+            if (fault_regions[i].handler(faulting_address, regs->err_code)) {
+                return;
+            }
+            break;
+        }
+    }
+
     int present = regs->err_code & 0x1;
     int rw = regs->err_code & 0x2;
     int us = regs->err_code & 0x4;
@@ -44,7 +272,10 @@ static void page_fault_handler(registers_t* regs) {
 
     extern void kprint(const char*);
     extern void kprint_hex(uint32_t);
+    extern void log_flush(void);
 
+    // Сначала ещё не выведенные записи лога, потом причина остановки
+    log_flush();
     kprint("Page fault! (");
     if (present) kprint("present ");
     if (rw) kprint("write ");
@@ -52,6 +283,8 @@ static void page_fault_handler(registers_t* regs) {
     if (reserved) kprint("reserved ");
     kprint(") at ");
     kprint_hex(faulting_address);
+    kprint(", eip ");
+    kprint_hex(regs->eip);
     kprint("\n");
 
     for(;;);
@@ -70,18 +303,46 @@ void vmm_init(void) {
         page_directory[i] = 0;
     }
 
-    for (int i = 0; i < 1024; i++) {
-        page_table_0[i] = (i * 0x1000) | PAGE_PRESENT | PAGE_WRITE;
-    }
+    uint32_t features = cpuid_features_edx();
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
 
-    for (int i = 0; i < 1024; i++) {
-        page_table_1[i] = ((i + 1024) * 0x1000) | PAGE_PRESENT | PAGE_WRITE;
+    if (features & CPUID_EDX_PSE) {
+        // Ядро и тождественная область: 4 МБ страницы, глобальные при наличии PGE
+        pse_enabled = 1;
+        pge_enabled = (features & CPUID_EDX_PGE) != 0;
+
+        uint32_t global = pge_enabled ? PAGE_GLOBAL : 0;
+        for (uint32_t i = 0; i < VMM_IDENTITY_SIZE / LARGE_PAGE_SIZE; i++) {
+            page_directory[i] = (i * LARGE_PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global;
+        }
+
+        cr4 |= 0x10;
+        if (pge_enabled) {
+            cr4 |= 0x80;
+        }
+        asm volatile("mov %0, %%cr4" : : "r" (cr4));
+    } else {
+        for (int i = 0; i < 1024; i++) {
+            page_table_0[i] = (i * 0x1000) | PAGE_PRESENT | PAGE_WRITE;
+        }
+
+        for (int i = 0; i < 1024; i++) {
+            page_table_1[i] = ((i + 1024) * 0x1000) | PAGE_PRESENT | PAGE_WRITE;
+        }
+
+        page_directory[0] = ((uint32_t)page_table_0) | PAGE_PRESENT | PAGE_WRITE;
+        page_directory[1] = ((uint32_t)page_table_1) | PAGE_PRESENT | PAGE_WRITE;
     }
 
-    page_directory[0] = ((uint32_t)page_table_0) | PAGE_PRESENT | PAGE_WRITE;
-    page_directory[1] = ((uint32_t)page_table_1) | PAGE_PRESENT | PAGE_WRITE;
+    kprint(pse_enabled ? "VMM: Identity mapping complete (4 MB pages)\n"
+                       : "VMM: Identity mapping complete\n");
 
-    kprint("VMM: Identity mapping complete\n");
+    for (int i = 0; i < 1024; i++) {
+        temp_table.entries[i] = 0;
+    }
+    page_directory[VMM_TEMP_PD_SLOT] = ((uint32_t)&temp_table) | PAGE_PRESENT | PAGE_WRITE;
+    page_directory[VMM_RECURSIVE_SLOT] = ((uint32_t)page_directory) | PAGE_PRESENT | PAGE_WRITE;
 
     kernel_directory = (page_directory_t*)page_directory;
     current_directory = kernel_directory;
@@ -102,12 +363,6 @@ void vmm_init(void) {
     kprint("VMM: Paging enabled!\n");
 }
 
-static inline void flush_tlb(void) {
-    uint32_t cr3;
-    asm volatile("mov %%cr3, %0" : "=r" (cr3));
-    asm volatile("mov %0, %%cr3" : : "r" (cr3) : "memory");
-}
-
 void vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
     page_table_t* table = vmm_get_page_table(virt, 1);
     if (table == 0) {
@@ -116,8 +371,8 @@ void vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
 
     uint32_t pt_index = (virt >> 12) & 0x3FF;
     table->entries[pt_index] = (phys & 0xFFFFF000) | (flags & 0xFFF) | PAGE_PRESENT;
-    
-    flush_tlb();
+
+    invlpg(virt);
 }
 
 void vmm_unmap_page(uint32_t virt) {
@@ -129,7 +384,214 @@ void vmm_unmap_page(uint32_t virt) {
     uint32_t pt_index = (virt >> 12) & 0x3FF;
     table->entries[pt_index] = 0;
 
+    invlpg(virt);
+}
+
+void vmm_map_range(uint32_t virt, uint32_t phys, uint32_t npages, uint32_t flags) {
+    uint32_t start = virt;
+    uint32_t done = 0;
+    int global = (flags & PAGE_GLOBAL) != 0;
+
+    // Таблица страниц берётся один раз на каждые 1024 записи
+    while (done < npages) {
+        page_table_t* table = vmm_get_page_table(virt, 1);
+        if (table == 0) {
+            break;
+        }
+
+        for (uint32_t i = (virt >> 12) & 0x3FF; i < 1024 && done < npages; i++) {
+            global |= table->entries[i] & PAGE_GLOBAL;
+            table->entries[i] = (phys & 0xFFFFF000) | (flags & 0xFFF) | PAGE_PRESENT;
+            virt += PAGE_SIZE;
+            phys += PAGE_SIZE;
+            done++;
+        }
+    }
+
+    flush_range(start, done, global);
+}
+
+void vmm_unmap_range(uint32_t virt, uint32_t npages) {
+    uint32_t start = virt;
+    uint32_t done = 0;
+    int global = 0;
+
+    while (done < npages) {
+        page_table_t* table = vmm_get_page_table(virt, 0);
+        uint32_t first = (virt >> 12) & 0x3FF;
+        uint32_t count = 1024 - first;
+        if (count > npages - done) {
+            count = npages - done;
+        }
+
+        if (table) {
+            for (uint32_t i = 0; i < count; i++) {
+                global |= table->entries[first + i] & PAGE_GLOBAL;
+                table->entries[first + i] = 0;
+            }
+        }
+
+        virt += count * PAGE_SIZE;
+        done += count;
+    }
+
+    flush_range(start, done, global);
+}
+
+int vmm_map_large(uint32_t virt, uint32_t phys, uint32_t flags) {
+    if (!pse_enabled || ((virt | phys) & (LARGE_PAGE_SIZE - 1))) {
+        return -1;
+    }
+
+    uint32_t pd_index = virt >> 22;
+    if (directories_cloned && kernel_pde(pd_index)) {
+        return -1;
+    }
+
+    // Уже существующую таблицу страниц молча не выбрасываем
+    pde_t old = sync_pde(pd_index);
+    if ((old & PAGE_PRESENT) && !(old & PAGE_LARGE)) {
+        return -1;
+    }
+
+    if (!pge_enabled) {
+        flags &= ~PAGE_GLOBAL;
+    }
+
+    set_pde(pd_index, phys | (flags & 0x1FF) | PAGE_PRESENT | PAGE_LARGE);
+    if (old & PAGE_PRESENT) {
+        invlpg(virt);
+    }
+    return 0;
+}
+
+int vmm_large_pages(void) {
+    return pse_enabled;
+}
+
+// Без обхода таблиц: PDE и PTE читаются напрямую через рекурсивное окно
+uint32_t vmm_virt_to_phys(uint32_t virt) {
+    pde_t pde = sync_pde(virt >> 22);
+    if (!(pde & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (pde & PAGE_LARGE) {
+        return (pde & 0xFFC00000) | (virt & 0x3FFFFF);
+    }
+
+    pte_t entry = ((pte_t*)VMM_PAGE_TABLES)[virt >> 12];
+    if (!(entry & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    return (entry & 0xFFFFF000) | (virt & 0xFFF);
+}
+
+// В клоне пользовательские PDE - всегда таблицы: 4 МБ страницы
+// разбиваются до копирования, и кадры делятся по счётчикам ссылок
+static void free_user_tables(page_directory_t* dir, uint32_t upto) {
+    for (uint32_t i = 0; i < upto; i++) {
+        pde_t pde = dir->entries[i];
+        if (kernel_pde(i) || i == VMM_RECURSIVE_SLOT || !(pde & PAGE_PRESENT)) {
+            continue;
+        }
+
+        page_table_t* table = (page_table_t*)vmm_temp_map(VMM_TEMP_TABLE, pde & 0xFFFFF000);
+        for (int j = 0; j < 1024; j++) {
+            if (table->entries[j] & PAGE_PRESENT) {
+                pmm_free_page(table->entries[j] & 0xFFFFF000);
+            }
+        }
+        vmm_temp_unmap(VMM_TEMP_TABLE);
+        pmm_free_page(pde & 0xFFFFF000);
+    }
+}
+
+// Копирует пользовательские таблицы страниц, а сами кадры делит между
+// каталогами: записываемые страницы становятся PAGE_COW только для чтения
+page_directory_t* vmm_clone_directory(void) {
+    if (!directories_cloned) {
+        if (split_kernel_large() != 0) {
+            return 0;
+        }
+        directories_cloned = 1;
+    }
+
+    uint32_t dir_phys = pmm_alloc_page();
+    if (dir_phys == 0) {
+        return 0;
+    }
+
+    page_directory_t* dir = (page_directory_t*)vmm_temp_map(VMM_TEMP_DIR, dir_phys);
+
+    for (uint32_t i = 0; i < 1024; i++) {
+        pde_t pde = VMM_PD->entries[i];
+
+        if (i == VMM_RECURSIVE_SLOT) {
+            dir->entries[i] = dir_phys | PAGE_PRESENT | PAGE_WRITE;
+            continue;
+        }
+        if (kernel_pde(i)) {
+            dir->entries[i] = kernel_directory->entries[i];
+            continue;
+        }
+        if (!(pde & PAGE_PRESENT)) {
+            dir->entries[i] = 0;
+            continue;
+        }
+
+        if ((pde & PAGE_LARGE) && split_large(i) == 0) {
+            free_user_tables(dir, i);
+            vmm_temp_unmap(VMM_TEMP_DIR);
+            pmm_free_page(dir_phys);
+            return 0;
+        }
+        pde = VMM_PD->entries[i];
+
+        uint32_t table_phys = pmm_alloc_page();
+        if (table_phys == 0) {
+            free_user_tables(dir, i);
+            vmm_temp_unmap(VMM_TEMP_DIR);
+            pmm_free_page(dir_phys);
+            return 0;
+        }
+
+        page_table_t* src = table_at(i);
+        page_table_t* dst = (page_table_t*)vmm_temp_map(VMM_TEMP_TABLE, table_phys);
+
+        for (int j = 0; j < 1024; j++) {
+            pte_t pte = src->entries[j];
+            if (pte & PAGE_PRESENT) {
+                if (pte & PAGE_WRITE) {
+                    pte = (pte & ~PAGE_WRITE) | PAGE_COW;
+                    src->entries[j] = pte;
+                }
+                pmm_ref_page(pte & 0xFFFFF000);
+            }
+            dst->entries[j] = pte;
+        }
+
+        vmm_temp_unmap(VMM_TEMP_TABLE);
+        dir->entries[i] = table_phys | (pde & 0xFFF);
+    }
+
+    vmm_temp_unmap(VMM_TEMP_DIR);
+
+    // Страницы родителя стали только для чтения
     flush_tlb();
+    return (page_directory_t*)dir_phys;
+}
+
+void vmm_free_directory(page_directory_t* dir) {
+    if (dir == kernel_directory || dir == current_directory) {
+        return;
+    }
+
+    uint32_t dir_phys = (uint32_t)dir;
+    page_directory_t* mapped = (page_directory_t*)vmm_temp_map(VMM_TEMP_DIR, dir_phys);
+    free_user_tables(mapped, VMM_RECURSIVE_SLOT);
+    vmm_temp_unmap(VMM_TEMP_DIR);
+    pmm_free_page(dir_phys);
 }
 
 void vmm_switch_directory(page_directory_t* dir) {
@@ -139,4 +601,96 @@ void vmm_switch_directory(page_directory_t* dir) {
 
 page_directory_t* vmm_get_directory(void) {
     return current_directory;
-}
\ No newline at end of file
+}
+
+void vmm_benchmark(void) {
+    extern void kprint(const char*);
+    extern void kprint_dec(uint32_t);
+
+    uint32_t phys = pmm_alloc_order(8);
+    if (phys == 0) {
+        kprint("vmbench: no contiguous 1 MB block\n");
+        return;
+    }
+
+    // Прежний путь: каждая страница сбрасывает весь TLB через CR3
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < VMM_BENCH_PAGES; i++) {
+        page_table_t* table = vmm_get_page_table(VMM_BENCH_BASE + i * PAGE_SIZE, 1);
+        if (table == 0) {
+            break;
+        }
+        table->entries[i & 0x3FF] = (phys + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE;
+        flush_tlb();
+    }
+    uint32_t cr3_cycles = (uint32_t)(rdtsc() - start);
+    vmm_unmap_range(VMM_BENCH_BASE, VMM_BENCH_PAGES);
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < VMM_BENCH_PAGES; i++) {
+        vmm_map_page(VMM_BENCH_BASE + i * PAGE_SIZE, phys + i * PAGE_SIZE, PAGE_PRESENT | PAGE_WRITE);
+    }
+    uint32_t invlpg_cycles = (uint32_t)(rdtsc() - start);
+    vmm_unmap_range(VMM_BENCH_BASE, VMM_BENCH_PAGES);
+
+    start = rdtsc();
+    vmm_map_range(VMM_BENCH_BASE, phys, VMM_BENCH_PAGES, PAGE_PRESENT | PAGE_WRITE);
+    uint32_t range_cycles = (uint32_t)(rdtsc() - start);
+    vmm_unmap_range(VMM_BENCH_BASE, VMM_BENCH_PAGES);
+
+    pmm_free_order(phys, 8);
+
+    kprint("Mapping 1 MB (256 pages), cycles:\n");
+    kprint("  per page + CR3 reload: ");
+    kprint_dec(cr3_cycles);
+    kprint("\n  per page + invlpg:     ");
+    kprint_dec(invlpg_cycles);
+    kprint("\n  vmm_map_range:         ");
+    kprint_dec(range_cycles);
+    kprint("\n");
+}
+
+// Проверка копирования при записи: после клонирования запись в дочернем
+// каталоге не должна быть видна родителю
+void vmm_cow_test(void) {
+    extern void kprint(const char*);
+
+    uint32_t frame = pmm_alloc_page();
+    if (frame == 0) {
+        kprint("cowtest: out of memory\n");
+        return;
+    }
+
+    volatile uint32_t* word = (volatile uint32_t*)VMM_COW_TEST_ADDR;
+    vmm_map_page(VMM_COW_TEST_ADDR, frame, PAGE_PRESENT | PAGE_WRITE);
+    *word = 0x1111;
+
+    page_directory_t* parent = current_directory;
+    page_directory_t* child = vmm_clone_directory();
+    if (child == 0) {
+        kprint("cowtest: clone failed\n");
+        vmm_unmap_page(VMM_COW_TEST_ADDR);
+        pmm_free_page(frame);
+        return;
+    }
+
+    int shared = pmm_page_refs(frame) == 2;
+
+    vmm_switch_directory(child);
+    uint32_t child_before = *word;
+    *word = 0x2222;
+    uint32_t child_phys = vmm_virt_to_phys(VMM_COW_TEST_ADDR);
+    vmm_switch_directory(parent);
+
+    uint32_t parent_value = *word;
+    *word = 0x3333;
+    int reused = vmm_virt_to_phys(VMM_COW_TEST_ADDR) == frame;
+
+    vmm_free_directory(child);
+    vmm_unmap_page(VMM_COW_TEST_ADDR);
+    pmm_free_page(frame);
+
+    int ok = shared && child_before == 0x1111 && child_phys != frame &&
+             parent_value == 0x1111 && reused;
+    kprint(ok ? "cowtest: OK\n" : "cowtest: FAILED\n");
+}
@@ -6,6 +6,23 @@
 #define PAGE_PRESENT 0x1
 #define PAGE_WRITE 0x2
 #define PAGE_USER 0x4
+#define PAGE_PWT 0x8
+#define PAGE_PCD 0x10
+#define PAGE_LARGE 0x80
+#define PAGE_GLOBAL 0x100
+#define PAGE_COW 0x200
+
+#define LARGE_PAGE_SIZE 0x400000
+
+// Окно временных отображений для доступа к произвольному кадру
+#define VMM_TEMP_BASE 0xFF800000
+#define VMM_TEMP_SPLIT 0
+#define VMM_TEMP_DIR 1
+#define VMM_TEMP_TABLE 2
+#define VMM_TEMP_COPY 3
+
+// Всё выше VMM_KERNEL_BASE (и нижние 8 МБ) - общая часть ядра
+#define VMM_KERNEL_BASE 0xC0000000
 
 typedef uint32_t pde_t;
 typedef uint32_t pte_t;
@@ -18,10 +35,27 @@ typedef struct page_table {
     pte_t entries[1024];
 } page_table_t;
 
+#define VMM_MAX_FAULT_REGIONS 4
+
+// Возвращает 1, если отсутствующая страница подставлена и доступ можно повторить
+typedef int (*vmm_fault_handler_t)(uint32_t addr, uint32_t err_code);
+
 void vmm_init(void);
 void vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
 void vmm_unmap_page(uint32_t virt);
+void vmm_map_range(uint32_t virt, uint32_t phys, uint32_t npages, uint32_t flags);
+void vmm_unmap_range(uint32_t virt, uint32_t npages);
+int vmm_map_large(uint32_t virt, uint32_t phys, uint32_t flags);
+int vmm_large_pages(void);
+void* vmm_temp_map(uint32_t slot, uint32_t phys);
+void vmm_temp_unmap(uint32_t slot);
+int vmm_register_fault_handler(uint32_t start, uint32_t end, vmm_fault_handler_t handler);
+uint32_t vmm_virt_to_phys(uint32_t virt);
+page_directory_t* vmm_clone_directory(void);
+void vmm_free_directory(page_directory_t* dir);
 void vmm_switch_directory(page_directory_t* dir);
 page_directory_t* vmm_get_directory(void);
+void vmm_benchmark(void);
+void vmm_cow_test(void);
 
 #endif
\ No newline at end of file